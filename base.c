@@ -44,8 +44,7 @@ struct stfl_widget_type *stfl_widget_types[] = {
 	0
 };
 
-int id_counter = 0;
-int curses_active = 0;
+static int id_counter = 0;
 
 struct stfl_widget *stfl_widget_new(const wchar_t *type)
 {
@@ -65,8 +64,13 @@ struct stfl_widget *stfl_widget_new(const wchar_t *type)
 	if (!t)
 		return 0;
 
+	return stfl_widget_new_type(t, setfocus);
+}
+
+struct stfl_widget *stfl_widget_new_type(struct stfl_widget_type *t, int setfocus)
+{
 	struct stfl_widget *w = calloc(1, sizeof(struct stfl_widget));
-	w->id = ++id_counter;
+	w->id = __sync_add_and_fetch(&id_counter, 1);
 	w->type = t;
 	w->setfocus = setfocus;
 	if (w->type->f_init)
@@ -74,10 +78,92 @@ struct stfl_widget *stfl_widget_new(const wchar_t *type)
 	return w;
 }
 
-void stfl_widget_free(struct stfl_widget *w)
+/* the number of forms with a checkpoint, nothing is stamped without one */
+int stfl_journal_forms = 0;
+static long long journal_seq;
+
+/* the change stamps are shared by all forms, so they can be compared with any checkpoint */
+long long stfl_journal_next()
+{
+	return __sync_add_and_fetch(&journal_seq, 1);
+}
+
+/*
+ * Stamps a changed kv, a widget which was added to its parent or a widget
+ * whose subtree must be sent as a whole (w->tree_changed). The parents get
+ * the stamp as subtree_changed, so stfl_dump_delta() can skip unchanged
+ * subtrees. Only the widgets of forms with a checkpoint are stamped, trees
+ * which are not part of a form yet are stamped when they are added.
+ */
+void stfl_journal_mark(struct stfl_widget *w, struct stfl_kv *kv, int added)
+{
+	struct stfl_widget *root;
+	long long seq;
+
+	for (root = w; root->parent; root = root->parent) ;
+	if (!root->form || !root->form->journal_active)
+		return;
+
+	seq = stfl_journal_next();
+
+	if (kv)
+		kv->changed = seq;
+	else if (added)
+		w->added = seq;
+	else
+		w->tree_changed = seq;
+
+	for (; w; w = w->parent)
+		w->subtree_changed = seq;
+}
+
+/*
+ * Links the widget c, which is not in a child list, into the child list of
+ * p before its child next (or as the last child when next is null). All
+ * inserts go through here, so prev_sibling always matches next_sibling.
+ */
+void stfl_widget_link_child(struct stfl_widget *p, struct stfl_widget *c, struct stfl_widget *next)
+{
+	c->parent = p;
+	c->next_sibling = next;
+	c->prev_sibling = next ? next->prev_sibling : p->last_child;
+
+	if (c->prev_sibling)
+		c->prev_sibling->next_sibling = c;
+	else
+		p->first_child = c;
+
+	if (next)
+		next->prev_sibling = c;
+	else
+		p->last_child = c;
+}
+
+void stfl_widget_unlink(struct stfl_widget *w)
+{
+	if (!w->parent)
+		return;
+
+	if (w->prev_sibling)
+		w->prev_sibling->next_sibling = w->next_sibling;
+	else
+		w->parent->first_child = w->next_sibling;
+
+	if (w->next_sibling)
+		w->next_sibling->prev_sibling = w->prev_sibling;
+	else
+		w->parent->last_child = w->prev_sibling;
+
+	w->parent = w->next_sibling = w->prev_sibling = 0;
+}
+
+static void widget_free(struct stfl_widget *w)
 {
-	while (w->first_child)
-		stfl_widget_free(w->first_child);
+	while (w->first_child) {
+		struct stfl_widget *c = w->first_child;
+		stfl_widget_unlink(c);
+		widget_free(c);
+	}
 
 	if (w->type->f_done)
 		w->type->f_done(w);
@@ -93,33 +179,123 @@ void stfl_widget_free(struct stfl_widget *w)
 		kv = next;
 	}
 
-	if (w->parent)
-	{
-		struct stfl_widget **pp = &w->parent->first_child;
-		while (*pp != w) {
-			pp = &(*pp)->next_sibling;
-		}
-		*pp = w->next_sibling;
-
-		if (w->parent->last_child == w) {
-			struct stfl_widget *p = w->parent->first_child;
-			w->parent->last_child = 0;
-			while (p) {
-				w->parent->last_child = p;
-				p = p->next_sibling;
-			}
-		}
-	}
-
 	if (w->name)
 		free(w->name);
 
 	if (w->cls)
 		free(w->cls);
 
+	if (w->lazy_src)
+		free(w->lazy_src);
+
 	free(w);
 }
 
+/* a widget removed from its parent changes the structure of the parent */
+void stfl_widget_free(struct stfl_widget *w)
+{
+	if (w->parent) {
+		stfl_journal_tree(w->parent);
+		stfl_widget_unlink(w);
+	}
+	widget_free(w);
+}
+
+static const wchar_t *subst_param(const wchar_t *p, const wchar_t **params, const wchar_t **end)
+{
+	int i;
+
+	if ((*end = wcschr(p+2, L')')) == 0)
+		return 0;
+
+	for (i = 0; params[i] && params[i+1]; i += 2)
+		if (!wcsncmp(params[i], p+2, *end-p-2) && params[i][*end-p-2] == 0)
+			return params[i+1];
+
+	return 0;
+}
+
+/* writes the substituted text to out (if not null) and returns its length */
+static size_t subst(wchar_t *out, const wchar_t *s, const wchar_t **params)
+{
+	const wchar_t *p, *end, *value;
+	size_t len = 0, n;
+
+	while ((p = wcsstr(s, L"$(")) != 0) {
+		value = subst_param(p, params, &end);
+		n = value ? p - s : p + 2 - s;
+		if (out)
+			wmemcpy(out + len, s, n);
+		len += n;
+		if (value) {
+			n = wcslen(value);
+			if (out)
+				wmemcpy(out + len, value, n);
+			len += n;
+			s = end + 1;
+		} else
+			s = p + 2;
+	}
+
+	n = wcslen(s);
+	if (out)
+		wmemcpy(out + len, s, n + 1);
+	return len + n;
+}
+
+/*
+ * Replaces every "$(name)" in s for which params (a null terminated list of
+ * name and value pairs) has a value. Other text is copied unchanged.
+ */
+static wchar_t *copy_subst(const wchar_t *s, const wchar_t **params)
+{
+	if (!params || !wcsstr(s, L"$("))
+		return compat_wcsdup(s);
+
+	wchar_t *ret = malloc((subst(0, s, params) + 1) * sizeof(wchar_t));
+	subst(ret, s, params);
+	return ret;
+}
+
+/*
+ * Deep copy of a widget tree, the copy gets new widget and kv ids. With
+ * params the placeholders in widget names, kv values and kv names are
+ * substituted (see copy_subst()).
+ */
+struct stfl_widget *stfl_widget_copy(struct stfl_widget *w, const wchar_t **params)
+{
+	struct stfl_widget *n = calloc(1, sizeof(struct stfl_widget));
+	struct stfl_kv *kv, **kv_tail = &n->kv_list;
+	struct stfl_widget *c;
+
+	n->id = __sync_add_and_fetch(&id_counter, 1);
+	n->type = w->type;
+	n->setfocus = w->setfocus;
+	n->parser_indent = w->parser_indent;
+	if (n->type->f_init)
+		n->type->f_init(n);
+
+	for (kv = w->kv_list; kv; kv = kv->next) {
+		struct stfl_kv *k = calloc(1, sizeof(struct stfl_kv));
+		k->widget = n;
+		k->key = compat_wcsdup(kv->key);
+		k->value = copy_subst(kv->value, params);
+		k->name = kv->name ? copy_subst(kv->name, params) : 0;
+		k->id = __sync_add_and_fetch(&id_counter, 1);
+		*kv_tail = k;
+		kv_tail = &k->next;
+	}
+
+	n->name = w->name ? copy_subst(w->name, params) : 0;
+	n->cls = w->cls ? compat_wcsdup(w->cls) : 0;
+	n->lazy_src = w->lazy_src ? copy_subst(w->lazy_src, params) : 0;
+
+	for (c = w->first_child; c; c = c->next_sibling)
+		stfl_widget_link_child(n, stfl_widget_copy(c, params), 0);
+
+	return n;
+}
+
 extern struct stfl_kv *stfl_widget_setkv_int(struct stfl_widget *w, const wchar_t *key, int value)
 {
 	wchar_t newtext[64];
@@ -134,6 +310,7 @@ struct stfl_kv *stfl_widget_setkv_str(struct stfl_widget *w, const wchar_t *key,
 		if (!wcscmp(kv->key, key)) {
 			free(kv->value);
 			kv->value = compat_wcsdup(value);
+			stfl_journal_kv(kv);
 			return kv;
 		}
 		kv = kv->next;
@@ -143,9 +320,36 @@ struct stfl_kv *stfl_widget_setkv_str(struct stfl_widget *w, const wchar_t *key,
 	kv->widget = w;
 	kv->key = compat_wcsdup(key);
 	kv->value = compat_wcsdup(value);
-	kv->id = ++id_counter;
+	kv->id = __sync_add_and_fetch(&id_counter, 1);
+	kv->next = w->kv_list;
+	w->kv_list = kv;
+	stfl_journal_kv(kv);
+	return kv;
+}
+
+/* like stfl_widget_setkv_str() but takes over the malloc()ed key and value */
+struct stfl_kv *stfl_widget_setkv_take(struct stfl_widget *w, wchar_t *key, wchar_t *value)
+{
+	struct stfl_kv *kv = w->kv_list;
+	while (kv) {
+		if (!wcscmp(kv->key, key)) {
+			free(kv->value);
+			kv->value = value;
+			free(key);
+			stfl_journal_kv(kv);
+			return kv;
+		}
+		kv = kv->next;
+	}
+
+	kv = calloc(1, sizeof(struct stfl_kv));
+	kv->widget = w;
+	kv->key = key;
+	kv->value = value;
+	kv->id = __sync_add_and_fetch(&id_counter, 1);
 	kv->next = w->kv_list;
 	w->kv_list = kv;
+	stfl_journal_kv(kv);
 	return kv;
 }
 
@@ -165,10 +369,12 @@ extern struct stfl_kv *stfl_setkv_by_name_str(struct stfl_widget *w, const wchar
 
 	free(kv->value);
 	kv->value = compat_wcsdup(value);
+	stfl_journal_kv(kv);
 	return kv;
 }
 
-static struct stfl_kv *stfl_widget_getkv_worker(struct stfl_widget *w, const wchar_t *key)
+/* only the kvs of the widget itself, without inherited @ kvs */
+struct stfl_kv *stfl_widget_getkv_worker(struct stfl_widget *w, const wchar_t *key)
 {
 	struct stfl_kv *kv = w->kv_list;
 	while (kv) {
@@ -182,7 +388,11 @@ static struct stfl_kv *stfl_widget_getkv_worker(struct stfl_widget *w, const wch
 struct stfl_kv *stfl_widget_getkv(struct stfl_widget *w, const wchar_t *key)
 {
 	struct stfl_kv *kv = stfl_widget_getkv_worker(w, key);
-	if (kv) return kv;
+	if (kv) {
+		if (stfl_stats_current)
+			stfl_stats_getkv(1);
+		return kv;
+	}
 
 	int key1_len = wcslen(key) + 2;
 	wchar_t key1[key1_len];
@@ -203,19 +413,22 @@ struct stfl_kv *stfl_widget_getkv(struct stfl_widget *w, const wchar_t *key)
 	{
 		if (key3_len) {
 			kv = stfl_widget_getkv_worker(w, key3);
-			if (kv) return kv;
+			if (kv) break;
 		}
 
 		kv = stfl_widget_getkv_worker(w, key2);
-		if (kv) return kv;
+		if (kv) break;
 
 		kv = stfl_widget_getkv_worker(w, key1);
-		if (kv) return kv;
+		if (kv) break;
 
 		w = w->parent;
 	}
 
-	return 0;
+	if (stfl_stats_current)
+		stfl_stats_getkv(kv ? -1 : 0);
+
+	return kv;
 }
 
 int stfl_widget_getkv_int(struct stfl_widget *w, const wchar_t *key, int defval)
@@ -258,11 +471,15 @@ const wchar_t *stfl_getkv_by_name_str(struct stfl_widget *w, const wchar_t *name
 	return kv ? kv->value : defval;
 }
 
+/* lazy subtrees are only parsed when their source may define the name */
 struct stfl_widget *stfl_widget_by_name(struct stfl_widget *w, const wchar_t *name)
 {
 	if (w->name && !wcscmp(w->name, name))
 		return w;
 
+	if (w->lazy_src && stfl_lazy_has_name(w->lazy_src, name))
+		stfl_widget_expand(w);
+
 	w = w->first_child;
 	while (w) {
 		struct stfl_widget *r = stfl_widget_by_name(w, name);
@@ -288,6 +505,7 @@ struct stfl_widget *stfl_widget_by_id(struct stfl_widget *w, int id)
 	return 0;
 }
 
+/* like stfl_widget_by_name() */
 struct stfl_kv *stfl_kv_by_name(struct stfl_widget *w, const wchar_t *name)
 {
 	struct stfl_kv *kv = w->kv_list;
@@ -297,6 +515,9 @@ struct stfl_kv *stfl_kv_by_name(struct stfl_widget *w, const wchar_t *name)
 		kv = kv->next;
 	}
 
+	if (w->lazy_src && stfl_lazy_has_name(w->lazy_src, name))
+		stfl_widget_expand(w);
+
 	w = w->first_child;
 	while (w) {
 		struct stfl_kv *r = stfl_kv_by_name(w, name);
@@ -342,6 +563,9 @@ extern struct stfl_widget *stfl_find_first_focusable(struct stfl_widget *w)
 	    stfl_widget_getkv_int(w, L".display", 1))
 		return w;
 
+	if (w->lazy_src && stfl_widget_getkv_int(w, L".display", 1))
+		stfl_widget_expand(w);
+
 	struct stfl_widget *c = w->first_child;
 	while (c) {
 		if (stfl_widget_getkv_int(w, L".display", 1)) {
@@ -357,16 +581,12 @@ extern struct stfl_widget *stfl_find_first_focusable(struct stfl_widget *w)
 
 int stfl_focus_prev(struct stfl_widget *w, struct stfl_widget *old_fw, struct stfl_form *f)
 {
-	struct stfl_widget *stop = stfl_find_child_tree(w, old_fw);
-
-	assert(stop);
+	struct stfl_widget *c = stfl_find_child_tree(w, old_fw);
 
-	while (w->first_child != stop)
-	{
-		struct stfl_widget *c = w->first_child;
-		while (c->next_sibling != stop)
-			c = c->next_sibling;
+	assert(c);
+	c = c->prev_sibling;
 
+	while (c) {
 		struct stfl_widget *new_fw = stfl_find_first_focusable(c);
 		if (new_fw) {
 			if (old_fw->type->f_leave)
@@ -378,8 +598,7 @@ int stfl_focus_prev(struct stfl_widget *w, struct stfl_widget *old_fw, struct st
 			f->current_focus_id = new_fw->id;
 			return 1;
 		}
-
-		stop = c;
+		c = c->prev_sibling;
 	}
 
 	return 0;
@@ -432,7 +651,12 @@ struct stfl_form *stfl_form_new()
 {
 	struct stfl_form *f = calloc(1, sizeof(struct stfl_form));
 	if (f) {
-		pthread_mutex_init(&f->mtx, NULL);
+		/* recursive, so API calls can be made between stfl_begin() and stfl_commit() */
+		pthread_mutexattr_t attr;
+		pthread_mutexattr_init(&attr);
+		pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+		pthread_mutex_init(&f->mtx, &attr);
+		pthread_mutexattr_destroy(&attr);
 	}
 	return f;
 }
@@ -442,6 +666,8 @@ void stfl_form_event(struct stfl_form *f, wchar_t *event)
 	struct stfl_event **ep = &f->event_queue;
 	struct stfl_event *e = calloc(1, sizeof(struct stfl_event));
 	e->event = event;
+	if (stfl_trace_enabled)
+		stfl_trace(STFL_TRACE_EVENT, f, 0, 0, event);
 	while (*ep)
 		ep = &(*ep)->next;
 	*ep = e;
@@ -463,9 +689,25 @@ static struct stfl_widget* stfl_gather_focus_widget(struct stfl_form* f)
 
 void stfl_form_run(struct stfl_form *f, int timeout)
 {
+	struct stfl_screen *s = f->screen ? f->screen : &stfl_screen_default;
+	int screen_locked = 0;
 	wchar_t *on_handler = 0;
+	long long run_start = 0, phase_start = 0, hold_start = 0;
 
-	pthread_mutex_lock(&f->mtx);
+	stfl_form_lock(f, L"stfl_run");
+
+	/* with the lock held, a batch can only be one of this thread */
+	if (timeout >= 0 && f->batch_depth > 0) {
+		fprintf(stderr, "STFL Fatal Error: Called stfl_run() between stfl_begin() and stfl_commit().\n");
+		abort();
+	}
+
+	if (f->stats || stfl_trace_enabled)
+		run_start = stfl_stats_now();
+	hold_start = run_start;
+	if (stfl_trace_enabled)
+		stfl_trace(STFL_TRACE_RUN, f, timeout, 0, 0);
+	stfl_stats_current = f->stats;
 
 	if (f->event)
 		free(f->event);
@@ -482,26 +724,23 @@ void stfl_form_run(struct stfl_form *f, int timeout)
 		abort();
 	}
 
-	if (!curses_active)
-	{
-		initscr();
-		cbreak();
-		noecho();
-		nonl();
-		keypad(stdscr, TRUE);
-		doupdate();
-		start_color();
-		use_default_colors();
-		wbkgdset(stdscr, ' ');
-		curses_active = 1;
-	}
+	stfl_screen_lock(s);
+	stfl_screen_start(s);
+	stfl_screen_unlock();
 
-	stfl_colorpair_counter = 1;
-	f->root->type->f_prepare(f->root, f);
+	if (stfl_trace_enabled)
+		phase_start = stfl_stats_now();
+	stfl_widget_prepare(f->root, f);
+	if (stfl_trace_enabled)
+		stfl_trace(STFL_TRACE_PREPARE, f, stfl_stats_now() - phase_start, 0, 0);
 
 	struct stfl_widget *fw = stfl_gather_focus_widget(f);
 	f->current_focus_id = fw ? fw->id : 0;
 
+	stfl_screen_lock(s);
+	screen_locked = 1;
+	s->colorpair_counter = 1;
+
 	getbegyx(stdscr, f->root->y, f->root->x);
 	getmaxyx(stdscr, f->root->h, f->root->w);
 
@@ -511,31 +750,78 @@ void stfl_form_run(struct stfl_form *f, int timeout)
 			fprintf(stderr, "STFL Fatal Error: stfl_form_run() got a NULL pointer from newwin(0, 0, 0, 0).\n");
 			abort();
 		}
-		f->root->type->f_draw(f->root, f, dummywin);
+		if (stfl_trace_enabled)
+			phase_start = stfl_stats_now();
+		stfl_widget_draw(f->root, f, dummywin);
+		if (stfl_trace_enabled)
+			stfl_trace(STFL_TRACE_DRAW, f, stfl_stats_now() - phase_start, 0, 0);
 		delwin(dummywin);
-		pthread_mutex_unlock(&f->mtx);
-		return;
+		goto unlock;
 	}
 
+	if (stfl_trace_enabled)
+		phase_start = stfl_stats_now();
 	werase(stdscr);
-	f->root->type->f_draw(f->root, f, stdscr);
+	stfl_widget_draw(f->root, f, stdscr);
 	if (timeout == -1 && f->root->cur_y != -1 && f->root->cur_x != -1) {
 		wmove(stdscr, f->root->cur_y, f->root->cur_x);
 	}
-	refresh();
+	if (stfl_trace_enabled)
+		stfl_trace(STFL_TRACE_DRAW, f, stfl_stats_now() - phase_start, 0, 0);
+
+	/* ncurses doesn't tell how many bytes it writes, count the damaged lines instead */
+	int touched_lines = 0;
+	if (stfl_trace_enabled) {
+		int y;
+		for (y = 0; y < getmaxy(stdscr); y++)
+			touched_lines += is_linetouched(stdscr, y) == TRUE;
+	}
 
-	if (timeout < 0) {
-		pthread_mutex_unlock(&f->mtx);
-		return;
+	if (timeout >= 0)
+		wmove(stdscr, f->cursor_y, f->cursor_x);
+
+	if (f->stats || stfl_trace_enabled)
+		phase_start = stfl_stats_now();
+	stfl_screen_refresh(s);
+	if (f->stats) {
+		stfl_stats_form(f->stats, STFL_STATS_REFRESH, phase_start);
+		stfl_stats_painted(f->stats);
 	}
+	if (stfl_trace_enabled)
+		stfl_trace(STFL_TRACE_REFRESH, f, stfl_stats_now() - phase_start, touched_lines, 0);
+
+	if (timeout < 0)
+		goto unlock;
 
-	wtimeout(stdscr, timeout == 0 ? -1 : timeout);
-	wmove(stdscr, f->cursor_y, f->cursor_x);
+	stfl_screen_unlock();
+	screen_locked = 0;
+	stfl_screen_flush(s);
 
 	wint_t wch;
+	stfl_stats_current = 0;
+	phase_start = f->stats ? stfl_stats_now() : 0;
+	if (f->stats && hold_start)
+		stfl_stats_hold(f->stats, hold_start);
 	pthread_mutex_unlock(&f->mtx);
-	int rc = wget_wch(stdscr, &wch);
-	pthread_mutex_lock(&f->mtx);
+	STFL_PROBE2(run_wait, f, timeout);
+	int rc = stfl_screen_get_wch(s, timeout == 0 ? -1 : timeout, &wch);
+	long long key_time = f->stats ? stfl_stats_now() : 0;
+	STFL_PROBE3(run_wake, f, rc, wch);
+	stfl_form_lock(f, L"stfl_run");
+
+	/* key names depend on the terminal */
+	stfl_screen_lock(s);
+	screen_locked = 1;
+	if (stfl_record_active)
+		stfl_record_key(f, rc, wch);
+	hold_start = f->stats ? stfl_stats_now() : 0;
+	if (f->stats && rc != ERR)
+		stfl_stats_key(f->stats, key_time ? key_time : hold_start);
+	if (stfl_trace_enabled)
+		stfl_trace(STFL_TRACE_KEY, f, rc == ERR ? -1 : (long long)wch, rc == KEY_CODE_YES, 0);
+	if (f->stats && phase_start)
+		stfl_stats_form(f->stats, STFL_STATS_INPUT, phase_start);
+	stfl_stats_current = f->stats;
 
 	/* fw may be invalid, regather it */
 	fw = stfl_gather_focus_widget(f);
@@ -543,8 +829,9 @@ void stfl_form_run(struct stfl_form *f, int timeout)
 
 	struct stfl_widget *w = fw;
 
+	/* nothing will ever be read from a closed remote screen */
 	if (rc == ERR) {
-		stfl_form_event(f, compat_wcsdup(L"TIMEOUT"));
+		stfl_form_event(f, compat_wcsdup(stfl_screen_closed(s) ? L"EOF" : L"TIMEOUT"));
 		goto unshift_next_event;
 	}
 
@@ -557,11 +844,13 @@ void stfl_form_run(struct stfl_form *f, int timeout)
 	while (w) {
 		const wchar_t *event = stfl_widget_getkv_str(w, on_handler, 0);
 		if (event) {
+			if (stfl_trace_enabled)
+				stfl_trace(STFL_TRACE_HANDLER, f, 0, 0, on_handler);
 			stfl_form_event(f, compat_wcsdup(event));
 			goto unshift_next_event;
 		}
 
-		if (w->type->f_process && stfl_widget_getkv_int(w, L"process", 1) && w->type->f_process(w, fw, f, wch, rc == KEY_CODE_YES))
+		if (w->type->f_process && stfl_widget_getkv_int(w, L"process", 1) && stfl_widget_process(w, fw, f, wch, rc == KEY_CODE_YES))
 			goto unshift_next_event;
 
 		if (stfl_widget_getkv_int(w, L"modal", 0))
@@ -663,35 +952,62 @@ unshift_next_event:;
 		free(e);
 	}
 
+unlock:
+	if (screen_locked) {
+		stfl_screen_unlock();
+		stfl_screen_flush(s);
+	}
+	if (f->stats && run_start)
+		stfl_stats_form(f->stats, STFL_STATS_RUN, run_start);
+	if (stfl_trace_enabled && run_start)
+		stfl_trace(STFL_TRACE_RUN_END, f, stfl_stats_now() - run_start, 0, 0);
+	if (f->stats && hold_start)
+		stfl_stats_hold(f->stats, hold_start);
+	stfl_stats_current = 0;
 	pthread_mutex_unlock(&f->mtx);
 	free(on_handler);
 }
 
 void stfl_form_reset()
 {
-	if (curses_active) {
-		endwin();
-		curses_active = 0;
-	}
+	stfl_screen_lock(&stfl_screen_default);
+	stfl_screen_stop(&stfl_screen_default);
+	stfl_screen_unlock();
 }
 
 void stfl_form_redraw()
 {
-	if (curses_active)
-		clearok(curscr, 1);
+	stfl_screen_redraw(&stfl_screen_default);
 }
 
 void stfl_form_free(struct stfl_form *f)
 {
 	pthread_mutex_lock(&f->mtx);
+	if (f->journal_active)
+		__sync_sub_and_fetch(&stfl_journal_forms, 1);
 	if (f->root)
 		stfl_widget_free(f->root);
 	if (f->event)
 		free(f->event);
+	while (f->event_queue) {
+		struct stfl_event *e = f->event_queue;
+		f->event_queue = e->next;
+		free(e->event);
+		free(e);
+	}
+	if (f->stats)
+		stfl_stats_free(f->stats);
 	pthread_mutex_unlock(&f->mtx);
 	free(f);
 }
 
+/* lazy subtrees find their form through the root widget */
+void stfl_form_set_root(struct stfl_form *f, struct stfl_widget *root)
+{
+	f->root = root;
+	root->form = f;
+}
+
 void stfl_check_setfocus(struct stfl_form *f, struct stfl_widget *w)
 {
 	if (w->setfocus) {
@@ -0,0 +1,605 @@
+/*
+ *  STFL - The Structured Terminal Forms Language/Library
+ *  Copyright (C) 2006, 2007  Clifford Wolf <clifford@clifford.at>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301 USA
+ *
+ *  bench.c: Microbenchmarks for the STFL core
+ *
+ *  This program is linked with -Wl,--wrap=malloc (etc.) against libstfl.a,
+ *  so the allocation counters only see allocations made by STFL itself and
+ *  not those made inside ncurses or the C library.
+ */
+
+#include "stfl_internals.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <locale.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+static struct stfl_form *form;
+static struct stfl_widget *widget;
+static struct stfl_ipool *ipool;
+static wchar_t *source;
+static char *source_utf8;
+static size_t source_utf8_len;
+static void *binary;
+static size_t binary_size;
+static WINDOW *win;
+static struct stfl_screen *remote;
+static struct stfl_template *template;
+static char include_file[] = "/tmp/stfl-bench-XXXXXX";
+static wchar_t include_text[64];
+
+static void setup_parse(long n)
+{
+	source = bench_gen_labels(n);
+}
+
+static void op_parse(long n)
+{
+	struct stfl_widget *w = stfl_parser(source);
+	stfl_widget_free(w);
+}
+
+static void teardown_source()
+{
+	free(source);
+	source = 0;
+}
+
+static void setup_parse_utf8(long n)
+{
+	wchar_t *text = bench_gen_labels(n);
+	source_utf8_len = wcstombs(0, text, 0);
+	source_utf8 = malloc(source_utf8_len + 1);
+	wcstombs(source_utf8, text, source_utf8_len + 1);
+	free(text);
+}
+
+static void op_parse_utf8(long n)
+{
+	struct stfl_widget *w = stfl_parser_utf8(source_utf8, source_utf8_len);
+	stfl_widget_free(w);
+}
+
+static void teardown_source_utf8()
+{
+	free(source_utf8);
+	source_utf8 = 0;
+}
+
+static void setup_binary(long n)
+{
+	wchar_t *text = bench_gen_labels(n);
+	const void *data = stfl_compile(text, &binary_size);
+	binary = malloc(binary_size);
+	memcpy(binary, data, binary_size);
+	free(text);
+}
+
+static void op_binary(long n)
+{
+	struct stfl_widget *w = stfl_binary_decode(binary, binary_size);
+	stfl_widget_free(w);
+}
+
+static void teardown_binary()
+{
+	free(binary);
+	binary = 0;
+}
+
+/* n hidden dialogs with 10 labels each, as bracketed STFL code */
+static wchar_t *gen_dialogs(long n, const wchar_t *flags)
+{
+	size_t size = 64 + n * (64 + 10 * 32), len;
+	wchar_t *text = malloc(size * sizeof(wchar_t));
+	long i, j;
+
+	len = swprintf(text, size, L"{vbox");
+	for (i = 0; i < n; i++) {
+		len += swprintf(text + len, size - len, L"{vbox[dlg%ld] .display:0%ls", i, flags);
+		for (j = 0; j < 10; j++)
+			len += swprintf(text + len, size - len, L"{label text:'line %ld'}", j);
+		len += swprintf(text + len, size - len, L"}");
+	}
+	swprintf(text + len, size - len, L"}");
+	return text;
+}
+
+static void setup_dialogs(long n)
+{
+	source = gen_dialogs(n, L"");
+}
+
+static void setup_dialogs_lazy(long n)
+{
+	source = gen_dialogs(n, L" .lazy:1");
+}
+
+static void setup_named_form(long n)
+{
+	wchar_t *text = bench_gen_labels(n);
+	form = stfl_create(text);
+	free(text);
+}
+
+static void teardown_form()
+{
+	stfl_free(form);
+	form = 0;
+}
+
+static void setup_snapshot(long n)
+{
+	setup_named_form(n);
+}
+
+static void op_snapshot(long n)
+{
+	stfl_snapshot(form, &binary_size);
+}
+
+static void setup_restore(long n)
+{
+	const void *data;
+
+	setup_named_form(n);
+	data = stfl_snapshot(form, &binary_size);
+	binary = malloc(binary_size);
+	memcpy(binary, data, binary_size);
+}
+
+static void op_restore(long n)
+{
+	stfl_free(stfl_restore(binary, binary_size));
+}
+
+static void teardown_restore()
+{
+	teardown_binary();
+	teardown_form();
+}
+
+static void op_get(long n)
+{
+	wchar_t name[32];
+	swprintf(name, 32, L"v%ld", n-1);
+	stfl_get(form, name);
+}
+
+static void op_set(long n)
+{
+	wchar_t name[32];
+	swprintf(name, 32, L"v%ld", n-1);
+	stfl_set(form, name, L"new value");
+}
+
+/* updates the first 100 variables, like a screen refresh */
+static void op_set_many(long n)
+{
+	wchar_t name[32];
+	long i;
+
+	for (i = 0; i < 100 && i < n; i++) {
+		swprintf(name, 32, L"v%ld", i);
+		stfl_set(form, name, L"new value");
+	}
+}
+
+static void op_set_batch(long n)
+{
+	stfl_begin(form);
+	op_set_many(n);
+	stfl_commit(form);
+}
+
+static void setup_deep(long n)
+{
+	long i;
+
+	form = stfl_form_new();
+	form->root = widget = stfl_widget_new(L"vbox");
+
+	for (i=1; i<n; i++) {
+		struct stfl_widget *c = stfl_widget_new(i == n-1 ? L"label" : L"vbox");
+		c->parent = widget;
+		widget->first_child = widget->last_child = c;
+		widget = c;
+	}
+}
+
+static void op_getkv_miss(long n)
+{
+	stfl_widget_getkv(widget, L"no_such_key");
+}
+
+static void op_style(long n)
+{
+	stfl_style(win, L"fg=red,bg=blue,attr=bold,attr=underline");
+}
+
+static void setup_richtext(long n)
+{
+	form = stfl_create(L"{label @style_em_normal:fg=yellow,attr=bold @style_a_normal:fg=cyan}");
+}
+
+static void op_richtext(long n)
+{
+	stfl_print_richtext(form->root, win, 0, 0,
+			L"plain <em>emphasised</> text <a>with</> a <<literal and <em>more</> styled words",
+			80, L"", 0);
+}
+
+static void op_dump(long n)
+{
+	stfl_dump(form, 0, L"p_", 1);
+}
+
+static int null_sink(void *ctx, const wchar_t *text, size_t len)
+{
+	return 0;
+}
+
+static void op_dump_cb(long n)
+{
+	stfl_dump_cb(form, 0, L"p_", 1, null_sink, 0);
+}
+
+static long long checkpoint;
+
+/* a few variables have changed since the last sync of a large form */
+static void setup_delta(long n)
+{
+	wchar_t name[32];
+	long i;
+
+	setup_named_form(n);
+	checkpoint = stfl_checkpoint(form);
+
+	for (i = 0; i < 10 && i < n; i++) {
+		swprintf(name, 32, L"v%ld", i * (n / 10));
+		stfl_set(form, name, L"new value");
+	}
+}
+
+static void op_delta(long n)
+{
+	stfl_dump_delta(form, checkpoint);
+}
+
+static void op_quote(long n)
+{
+	stfl_quote(L"A line with \"double\" and 'single' quotes, twice: \"a\" 'b', and some padding text after it.");
+}
+
+static void op_quote_into(long n)
+{
+	wchar_t buf[256];
+	stfl_quote_into(buf, 256, L"A line with \"double\" and 'single' quotes, twice: \"a\" 'b', and some padding text after it.");
+}
+
+static void setup_include(long n)
+{
+	wchar_t *text = bench_gen_labels(n);
+	int fd = mkstemp(include_file);
+	FILE *f = fdopen(fd, "w");
+	fprintf(f, "%ls", text);
+	fflush(f);
+	free(text);
+
+	/* files written within the last second are not cached */
+	struct timespec times[2] = { { 0, UTIME_OMIT }, { time(0) - 10, 0 } };
+	futimens(fd, times);
+	fclose(f);
+
+	swprintf(include_text, 64, L"<%s>", include_file);
+	form = stfl_create(L"{vbox[outer]}");
+}
+
+static void op_include(long n)
+{
+	stfl_modify(form, L"outer", L"replace_inner", include_text);
+}
+
+static void teardown_include()
+{
+	teardown_form();
+	unlink(include_file);
+	strcpy(include_file, "/tmp/stfl-bench-XXXXXX");
+}
+
+/* one CSV row of n input cells, like python/example.py creates them */
+static void setup_row(long n)
+{
+	long i;
+	size_t len = 0;
+
+	source = malloc((n * 96 + 32) * sizeof(wchar_t));
+	len += swprintf(source + len, 32, L"{hbox");
+	for (i = 0; i < n; i++)
+		len += swprintf(source + len, 96, L"{input[cell_$(row)_%ld] text[value_$(row)_%ld]:$(v) style_focus:bg=blue}", i, i);
+	swprintf(source + len, 32, L"}");
+
+	template = stfl_template_create(source);
+	form = stfl_create(L"{vbox[rows]}");
+}
+
+static void op_row_template(long n)
+{
+	stfl_template_instantiate(form, L"rows", L"replace_inner", template, L"row", L"1", L"v", L"x", NULL);
+}
+
+static void op_row_modify(long n)
+{
+	wchar_t text[n * 96 + 32];
+	const wchar_t *s;
+	size_t len = 0;
+
+	/* what an application has to do without templates */
+	for (s = source; *s; s++) {
+		if (!wcsncmp(s, L"$(row)", 6))
+			text[len++] = L'1', s += 5;
+		else if (!wcsncmp(s, L"$(v)", 4))
+			text[len++] = L'x', s += 3;
+		else
+			text[len++] = *s;
+	}
+	text[len] = 0;
+
+	stfl_modify(form, L"rows", L"replace_inner", text);
+}
+
+static void op_row_build(long n)
+{
+	struct stfl_widget *row = stfl_widget_create(L"hbox");
+	wchar_t name[32];
+	long i;
+
+	for (i = 0; i < n; i++) {
+		struct stfl_widget *w = stfl_widget_create(L"input");
+		swprintf(name, 32, L"cell_1_%ld", i);
+		stfl_widget_set_name(w, name);
+		swprintf(name, 32, L"value_1_%ld", i);
+		stfl_widget_set_kv(w, L"text", name, L"x");
+		stfl_widget_set_kv(w, L"style_focus", 0, L"bg=blue");
+		stfl_widget_append_child(row, w);
+	}
+
+	stfl_attach(form, L"rows", L"replace_inner", row);
+}
+
+static void teardown_row()
+{
+	stfl_template_free(template);
+	template = 0;
+	teardown_source();
+	teardown_form();
+}
+
+static long ipool_ops;
+
+/* the pool is flushed every 1024 conversions, like a program would do it */
+static void ipool_op_done()
+{
+	if (++ipool_ops % 1024 == 0)
+		stfl_ipool_flush(ipool);
+}
+
+static void setup_ipool(long n)
+{
+	ipool = stfl_ipool_create("UTF-8");
+	ipool_ops = 0;
+}
+
+static void teardown_ipool()
+{
+	stfl_ipool_destroy(ipool);
+	ipool = 0;
+}
+
+static void op_ipool_towc(long n)
+{
+	stfl_ipool_towc(ipool, "Gr\xc3\xbc\xc3\x9f" "e aus der ipool Konvertierung, etwa hundert Bytes lang \xe2\x82\xac \xe2\x82\xac \xe2\x82\xac.");
+	ipool_op_done();
+}
+
+static void op_ipool_fromwc(long n)
+{
+	stfl_ipool_fromwc(ipool, L"Grüße aus der ipool Konvertierung, etwa hundert Zeichen lang € € €.");
+	ipool_op_done();
+}
+
+static void setup_list(long n)
+{
+	wchar_t *text = bench_gen_list(n);
+	form = stfl_create(text);
+	free(text);
+}
+
+/* source is the list widget of the form, without the vbox around it */
+static void setup_list_source(long n)
+{
+	setup_list(n);
+	source = bench_gen_list(n);
+	wmemmove(source, wcsstr(source, L"{list"), wcslen(source));
+	source[wcslen(source)-1] = 0;
+}
+
+static void op_replace(long n)
+{
+	stfl_modify(form, L"list", L"replace", source);
+}
+
+static void op_reconcile(long n)
+{
+	stfl_modify(form, L"list", L"reconcile", source);
+}
+
+static void teardown_list_source()
+{
+	teardown_source();
+	teardown_form();
+}
+
+static void setup_table(long n)
+{
+	wchar_t *text = bench_gen_table(n);
+	form = stfl_create(text);
+	free(text);
+}
+
+static void setup_table_stats(long n)
+{
+	setup_table(n);
+	stfl_stats_enable(form, 1);
+}
+
+static void op_prepare_draw(long n)
+{
+	bench_prepare_draw(form, win);
+}
+
+/* the client of the remote screen is /dev/null */
+static void setup_remote(long n)
+{
+	int fd = open("/dev/null", O_RDWR);
+	wchar_t *text = bench_gen_labels(n);
+
+	form = stfl_create(text);
+	free(text);
+
+	remote = stfl_screen_create_remote(fd, fd);
+	close(fd);
+	stfl_screen_attach(form, remote);
+	stfl_run(form, -1);
+}
+
+static void op_remote(long n)
+{
+	static int i;
+
+	stfl_set(form, L"v3", i++ % 2 ? L"item text" : L"item next");
+	stfl_run(form, -1);
+}
+
+static void teardown_remote()
+{
+	teardown_form();
+	stfl_screen_free(remote);
+
+	/* back to the headless screen of the other cases */
+	stfl_screen_lock(bench_screen);
+	stfl_screen_unlock();
+}
+
+static struct bench_case cases[] = {
+	{ "parse",          1000, setup_parse,      op_parse,         teardown_source },
+	{ "parse",         10000, setup_parse,      op_parse,         teardown_source },
+	{ "parse",        100000, setup_parse,      op_parse,         teardown_source },
+	{ "parse",       1000000, setup_parse,      op_parse,         teardown_source },
+	{ "parse_utf8",     1000, setup_parse_utf8, op_parse_utf8,    teardown_source_utf8 },
+	{ "parse_utf8",  1000000, setup_parse_utf8, op_parse_utf8,    teardown_source_utf8 },
+	{ "binary",         1000, setup_binary,     op_binary,        teardown_binary },
+	{ "binary",      1000000, setup_binary,     op_binary,        teardown_binary },
+	{ "snapshot",     100000, setup_snapshot,   op_snapshot,      teardown_form },
+	{ "restore",      100000, setup_restore,    op_restore,       teardown_restore },
+	{ "dialogs",         100, setup_dialogs,    op_parse,         teardown_source },
+	{ "dialogs_lazy",    100, setup_dialogs_lazy, op_parse,       teardown_source },
+	{ "include",         100, setup_include,    op_include,       teardown_include },
+	{ "include",       10000, setup_include,    op_include,       teardown_include },
+	{ "row_template",     10, setup_row,        op_row_template,  teardown_row },
+	{ "row_modify",       10, setup_row,        op_row_modify,    teardown_row },
+	{ "row_build",        10, setup_row,        op_row_build,     teardown_row },
+	{ "get",            1000, setup_named_form, op_get,           teardown_form },
+	{ "get",          100000, setup_named_form, op_get,           teardown_form },
+	{ "set",            1000, setup_named_form, op_set,           teardown_form },
+	{ "set",          100000, setup_named_form, op_set,           teardown_form },
+	{ "set_many",       1000, setup_named_form, op_set_many,      teardown_form },
+	{ "set_batch",      1000, setup_named_form, op_set_batch,     teardown_form },
+	{ "getkv_miss",        4, setup_deep,       op_getkv_miss,    teardown_form },
+	{ "getkv_miss",       64, setup_deep,       op_getkv_miss,    teardown_form },
+	{ "style",             1, 0,                op_style,         0 },
+	{ "richtext",          1, setup_richtext,   op_richtext,      teardown_form },
+	{ "dump",           1000, setup_named_form, op_dump,          teardown_form },
+	{ "dump",         100000, setup_named_form, op_dump,          teardown_form },
+	{ "dump_cb",        1000, setup_named_form, op_dump_cb,       teardown_form },
+	{ "dump_cb",      100000, setup_named_form, op_dump_cb,       teardown_form },
+	{ "dump_delta",     1000, setup_delta,      op_delta,         teardown_form },
+	{ "dump_delta",   100000, setup_delta,      op_delta,         teardown_form },
+	{ "quote",             1, 0,                op_quote,         0 },
+	{ "quote_into",        1, 0,                op_quote_into,    0 },
+	{ "ipool_towc",        1, setup_ipool,      op_ipool_towc,    teardown_ipool },
+	{ "ipool_fromwc",      1, setup_ipool,      op_ipool_fromwc,  teardown_ipool },
+	{ "replace",        1000, setup_list_source, op_replace,      teardown_list_source },
+	{ "reconcile",      1000, setup_list_source, op_reconcile,    teardown_list_source },
+	{ "draw_list",      1000, setup_list,       op_prepare_draw,  teardown_form },
+	{ "draw_list",    100000, setup_list,       op_prepare_draw,  teardown_form },
+	{ "draw_table",      100, setup_table,      op_prepare_draw,  teardown_form },
+	{ "draw_table",      841, setup_table,      op_prepare_draw,  teardown_form },
+	{ "draw_table_stats", 841, setup_table_stats, op_prepare_draw, teardown_form },
+	{ "remote_frame",     20, setup_remote,     op_remote,        teardown_remote },
+	{ 0 }
+};
+
+int main(int argc, char **argv)
+{
+	long max_n = 1000000;
+	const char *filter = 0;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-n") && i+1 < argc)
+			max_n = atol(argv[++i]);
+		else
+			filter = argv[i];
+	}
+
+	if (!setlocale(LC_ALL, "C.UTF-8"))
+		setlocale(LC_ALL, "");
+
+	win = bench_screen_open();
+	if (!win) {
+		fprintf(stderr, "Can't open a headless curses screen (check $TERM).\n");
+		return 1;
+	}
+
+	printf("%-16s %9s %10s %14s %12s %14s\n", "case", "n", "iters", "ns/op", "allocs/op", "bytes/op");
+
+	for (i=0; cases[i].name; i++) {
+		if (cases[i].n > max_n)
+			continue;
+		if (filter && !strstr(cases[i].name, filter))
+			continue;
+
+		struct bench_result r;
+		bench_run(&cases[i], &r);
+		printf("%-16s %9ld %10ld %14.1f %12.2f %14.1f\n", cases[i].name, cases[i].n,
+				r.iters, r.ns_per_op, r.allocs_per_op, r.bytes_per_op);
+		fflush(stdout);
+	}
+
+	bench_screen_close();
+	return 0;
+}
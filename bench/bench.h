@@ -0,0 +1,59 @@
+/*
+ *  STFL - The Structured Terminal Forms Language/Library
+ *  Copyright (C) 2006, 2007  Clifford Wolf <clifford@clifford.at>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301 USA
+ *
+ *  bench.h: Shared helpers for the STFL benchmark programs
+ */
+
+#ifndef STFL__BENCH_H
+#define STFL__BENCH_H 1
+
+#include "stfl_internals.h"
+
+struct bench_case {
+	const char *name;
+	long n;
+	void (*f_setup)(long n);
+	void (*f_op)(long n);
+	void (*f_teardown)();
+};
+
+struct bench_result {
+	long iters;
+	double ns_per_op;
+	double allocs_per_op;
+	double bytes_per_op;
+};
+
+extern unsigned long bench_alloc_count;
+extern unsigned long bench_alloc_bytes;
+
+extern long long bench_now_ns();
+extern void bench_run(struct bench_case *c, struct bench_result *r);
+
+extern wchar_t *bench_gen_labels(long n);
+extern wchar_t *bench_gen_list(long n);
+extern wchar_t *bench_gen_table(long n);
+
+extern struct stfl_screen *bench_screen;
+
+extern WINDOW *bench_screen_open();
+extern void bench_screen_close();
+extern void bench_prepare_draw(struct stfl_form *f, WINDOW *win);
+
+#endif
@@ -0,0 +1,317 @@
+/*
+ *  STFL - The Structured Terminal Forms Language/Library
+ *  Copyright (C) 2006, 2007  Clifford Wolf <clifford@clifford.at>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301 USA
+ *
+ *  check.c: Regression checks for bugs found in the STFL core
+ *
+ *  Every check prints "ok" or "FAILED" and the program exits with a
+ *  non-zero status when one of them failed.
+ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <locale.h>
+#include <sys/socket.h>
+
+/* the dump of the form (or widget) must be exactly the expected text */
+static int dump_is(struct stfl_form *f, const wchar_t *name, const wchar_t *expected)
+{
+	const wchar_t *text = stfl_dump(f, name, L"", 0);
+
+	if (text && !wcscmp(text, expected))
+		return 1;
+
+	printf("    got:      %ls\n    expected: %ls\n", text ? text : L"(null)", expected);
+	return 0;
+}
+
+/* reconcile must not change an inherited @ kv of an ancestor */
+static int check_reconcile_inherited(void)
+{
+	struct stfl_form *f = stfl_create(L"{vbox[root] @style_normal:fg=blue {label[l] text:hi}}");
+	int ok;
+
+	stfl_modify(f, L"l", L"reconcile", L"{label[l] text:hi style_normal:fg=red}");
+	ok = dump_is(f, 0, L"{vbox[\"root\"] @style_normal:\"fg=blue\"{label[\"l\"] style_normal:\"fg=red\" text:\"hi\"}}");
+
+	stfl_free(f);
+	return ok;
+}
+
+/* reconcile removes kvs which are not in the new text, but not the widget state */
+static int check_reconcile_dropped(void)
+{
+	struct stfl_form *f = stfl_create(L"{list[l] style_focus:fg=red pos:1 {listitem text:a} {listitem text:b}}");
+	int ok;
+
+	stfl_modify(f, L"l", L"reconcile", L"{list[l] {listitem text:a} {listitem text:b}}");
+	ok = dump_is(f, 0, L"{list[\"l\"] pos:\"1\"{listitem text:\"a\"}{listitem text:\"b\"}}");
+
+	stfl_free(f);
+	return ok;
+}
+
+/* a "set" line of a delta must not change an inherited @ kv either */
+static int check_delta_inherited(void)
+{
+	struct stfl_form *f = stfl_create(L"{vbox[root] @style_normal:fg=blue {label[l] text:hi}}");
+	int ok;
+
+	stfl_apply_delta(f, L"set /0 {label style_normal:fg=red}\n");
+	ok = dump_is(f, 0, L"{vbox[\"root\"] @style_normal:\"fg=blue\"{label[\"l\"] style_normal:\"fg=red\" text:\"hi\"}}");
+
+	stfl_free(f);
+	return ok;
+}
+
+/* the journal of a form with a checkpoint has its changes and parsed lazy subtrees */
+static int check_delta_journal(void)
+{
+	struct stfl_form *other = stfl_create(L"{vbox {label text[ov]:x}}");
+	struct stfl_form *f = stfl_create(L"vbox\n  label text[v]:x\n  vbox .lazy:1\n    label text[inner]:y\n");
+	const wchar_t *expected = L"set /0 {label text[\"v\"]:\"z\"}\ntree /1 {vbox .lazy:\"1\"{label text[\"inner\"]:\"y\"}}\n";
+	long long since = stfl_checkpoint(f);
+	const wchar_t *delta;
+	int ok;
+
+	stfl_set(other, L"ov", L"z");
+	stfl_set(f, L"v", L"z");
+	stfl_get(f, L"inner");
+
+	delta = stfl_dump_delta(f, since);
+	ok = delta && !wcscmp(delta, expected);
+	if (!ok)
+		printf("    got:      %ls    expected: %ls", delta ? delta : L"(null)\n", expected);
+
+	stfl_free(other);
+	stfl_free(f);
+	return ok;
+}
+
+/* the widget functions handle unknown types and children with a parent */
+static int check_widget_api(void)
+{
+	struct stfl_widget *bad = stfl_widget_create(L"nosuchtype");
+	struct stfl_widget *box = stfl_widget_create(L"vbox"), *other = stfl_widget_create(L"vbox");
+	struct stfl_widget *label = stfl_widget_create(L"label");
+	int ok = bad == 0;
+
+	stfl_widget_set_name(bad, L"x");
+	stfl_widget_set_class(bad, L"x");
+	stfl_widget_set_kv(bad, L"text", 0, L"x");
+	stfl_widget_destroy(bad);
+
+	ok &= stfl_widget_append_child(box, label) == 1;
+	ok &= stfl_widget_append_child(other, label) == 0;
+	ok &= stfl_widget_append_child(label, box) == 0;
+	ok &= stfl_widget_append_child(box, 0) == 0;
+
+	stfl_widget_destroy(box);
+	stfl_widget_destroy(other);
+	return ok;
+}
+
+/* a name defined by an include in a lazy subtree is found */
+static int check_lazy_include(void)
+{
+	char filename[] = "/tmp/stfl-check-XXXXXX";
+	int fd = mkstemp(filename);
+	wchar_t text[128];
+	int ok;
+
+	if (fd < 0 || write(fd, "label text[innervar]:x\n", 23) != 23)
+		return 0;
+	close(fd);
+
+	swprintf(text, 128, L"vbox\n  vbox[dlg] .lazy:1 .display:0\n    <%s>\n", filename);
+	struct stfl_form *f = stfl_create(text);
+
+	stfl_set(f, L"innervar", L"y");
+	const wchar_t *value = stfl_get(f, L"innervar");
+	unlink(filename);
+	ok = value && !wcscmp(value, L"y");
+	if (!ok)
+		printf("    got: %ls\n", value ? value : L"(null)");
+
+	stfl_free(f);
+	return ok;
+}
+
+/* lookups of names which are not in a lazy subtree don't parse it */
+static int check_lazy_lookup(void)
+{
+	struct stfl_form *f = stfl_create(L"vbox\n  vbox[dlg] .lazy:1 .display:0\n    label[l] text['a b']:x\n  label text[outer]:x\n");
+	int ok;
+
+	stfl_set(f, L"outer", L"y");
+	stfl_get(f, L"missing");
+	stfl_get(f, L"a");
+	ok = wcsstr(stfl_memory_stats(f), L"widgets:3 ") != 0;
+	if (!ok)
+		printf("    got: %ls", stfl_memory_stats(f));
+
+	/* quotes in the name block are removed like the parser does it */
+	stfl_set(f, L"a b", L"y");
+	if (wcscmp(stfl_get(f, L"a b"), L"y")) {
+		printf("    got: %ls for \"a b\"\n", stfl_get(f, L"a b"));
+		ok = 0;
+	}
+
+	stfl_free(f);
+	return ok;
+}
+
+/* a '!' focus marker in a lazy subtree takes the focus when it is parsed */
+static int check_lazy_setfocus(void)
+{
+	struct stfl_form *f = stfl_create(L"vbox\n  input[a]\n  vbox .lazy:1\n    !input[b] text[bvar]:x\n");
+	const wchar_t *focus;
+	int ok;
+
+	stfl_get(f, L"bvar");
+	focus = stfl_get_focus(f);
+	ok = focus && !wcscmp(focus, L"b");
+	if (!ok)
+		printf("    got: %ls\n", focus ? focus : L"(null)");
+
+	stfl_free(f);
+	return ok;
+}
+
+/* an include file which is rewritten in the same second is parsed again */
+static int check_include_rewritten(void)
+{
+	char filename[] = "/tmp/stfl-check-XXXXXX";
+	int fd = mkstemp(filename), i, ok = 1;
+	wchar_t text[64];
+
+	if (fd < 0)
+		return 0;
+	close(fd);
+	swprintf(text, 64, L"<%s>", filename);
+
+	for (i = 0; i < 2; i++) {
+		const char *src = i ? "label text:B\n" : "label text:A\n";
+		FILE *file = fopen(filename, "w");
+		fputs(src, file);
+		fclose(file);
+
+		struct stfl_form *f = stfl_create(text);
+		ok &= dump_is(f, 0, i ? L"{label text:\"B\"}" : L"{label text:\"A\"}");
+		stfl_free(f);
+	}
+
+	unlink(filename);
+	return ok;
+}
+
+/* asking an ipool for its usage does not change it */
+static int check_ipool_stats(void)
+{
+	struct stfl_ipool *pool = stfl_ipool_create("UTF-8");
+	wchar_t first[256];
+	int ok;
+
+	stfl_ipool_towc(pool, "text");
+	wcscpy(first, stfl_ipool_stats(pool));
+	ok = !wcscmp(first, stfl_ipool_stats(pool));
+	if (!ok)
+		printf("    got:      %ls    expected: %ls", stfl_ipool_stats(pool), first);
+
+	stfl_ipool_destroy(pool);
+	return ok;
+}
+
+/* key code 0 is a key, a closed client ends stfl_run() with "EOF" */
+static int check_remote_closed(void)
+{
+	struct stfl_form *f = stfl_create(L"{vbox {label text:hi}}");
+	struct stfl_screen *s;
+	const wchar_t *event;
+	int sv[2], ok;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0 || (s = stfl_screen_create_remote(sv[0], sv[0])) == 0)
+		return 0;
+	stfl_screen_attach(f, s);
+
+	if (write(sv[1], "k 0\n", 4) != 4)
+		return 0;
+	event = stfl_run(f, 1000);
+	ok = event && wcscmp(event, L"TIMEOUT");
+	if (!ok)
+		printf("    got: %ls for key 0\n", event ? event : L"(null)");
+
+	close(sv[1]);
+	event = stfl_run(f, 0);
+	if (!event || wcscmp(event, L"EOF")) {
+		printf("    got: %ls after close\n", event ? event : L"(null)");
+		ok = 0;
+	}
+
+	stfl_free(f);
+	stfl_screen_free(s);
+	close(sv[0]);
+	return ok;
+}
+
+static struct {
+	const char *name;
+	int (*f_check)(void);
+} checks[] = {
+	{ "reconcile_inherited", check_reconcile_inherited },
+	{ "reconcile_dropped",   check_reconcile_dropped },
+	{ "delta_inherited",     check_delta_inherited },
+	{ "delta_journal",       check_delta_journal },
+	{ "widget_api",          check_widget_api },
+	{ "lazy_include",        check_lazy_include },
+	{ "lazy_lookup",         check_lazy_lookup },
+	{ "lazy_setfocus",       check_lazy_setfocus },
+	{ "include_rewritten",   check_include_rewritten },
+	{ "ipool_stats",         check_ipool_stats },
+	{ "remote_closed",       check_remote_closed },
+	{ 0 }
+};
+
+int main(int argc, char **argv)
+{
+	const char *filter = argc > 1 ? argv[1] : 0;
+	int failed = 0;
+	int i;
+
+	if (!setlocale(LC_ALL, "C.UTF-8"))
+		setlocale(LC_ALL, "");
+
+	for (i=0; checks[i].name; i++)
+	{
+		if (filter && !strstr(checks[i].name, filter))
+			continue;
+
+		int ok = checks[i].f_check();
+		printf("%-24s %s\n", checks[i].name, ok ? "ok" : "FAILED");
+		fflush(stdout);
+
+		if (!ok)
+			failed = 1;
+	}
+
+	return failed;
+}
@@ -0,0 +1,214 @@
+/*
+ *  STFL - The Structured Terminal Forms Language/Library
+ *  Copyright (C) 2006, 2007  Clifford Wolf <clifford@clifford.at>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301 USA
+ *
+ *  common.c: Timing, allocation counting and form generators
+ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Only run an operation for this long once it has been calibrated */
+#define BENCH_TARGET_NS 200000000LL
+
+unsigned long bench_alloc_count = 0;
+unsigned long bench_alloc_bytes = 0;
+
+extern void *__real_malloc(size_t size);
+extern void *__real_calloc(size_t nmemb, size_t size);
+extern void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+	bench_alloc_count++;
+	bench_alloc_bytes += size;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	bench_alloc_count++;
+	bench_alloc_bytes += nmemb * size;
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	bench_alloc_count++;
+	bench_alloc_bytes += size;
+	return __real_realloc(ptr, size);
+}
+
+long long bench_now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void bench_run(struct bench_case *c, struct bench_result *r)
+{
+	long iters = 1, i;
+	long long t;
+
+	if (c->f_setup)
+		c->f_setup(c->n);
+
+	while (1) {
+		unsigned long count = bench_alloc_count;
+		unsigned long bytes = bench_alloc_bytes;
+
+		t = bench_now_ns();
+		for (i=0; i<iters; i++)
+			c->f_op(c->n);
+		t = bench_now_ns() - t;
+
+		r->iters = iters;
+		r->ns_per_op = (double)t / iters;
+		r->allocs_per_op = (double)(bench_alloc_count - count) / iters;
+		r->bytes_per_op = (double)(bench_alloc_bytes - bytes) / iters;
+
+		/* the first run also pays for cold caches and page faults */
+		if (t >= BENCH_TARGET_NS || (iters > 1 && t >= BENCH_TARGET_NS / 4))
+			break;
+
+		iters = t > 0 ? iters * (BENCH_TARGET_NS / t) + 1 : iters * 100;
+		if (iters < 1)
+			iters = 1;
+	}
+
+	if (c->f_teardown)
+		c->f_teardown();
+}
+
+struct genbuf {
+	wchar_t *text;
+	size_t len, size;
+};
+
+static void genbuf_printf(struct genbuf *b, const wchar_t *fmt, long a, long c)
+{
+	if (b->size - b->len < 256) {
+		b->size = b->size ? b->size * 2 : 4096;
+		b->text = realloc(b->text, b->size * sizeof(wchar_t));
+	}
+	b->len += swprintf(b->text + b->len, b->size - b->len, fmt, a, c);
+}
+
+/* a vbox with n labels, each with a named "text" variable v0..v(n-1) */
+wchar_t *bench_gen_labels(long n)
+{
+	struct genbuf b = { 0, 0, 0 };
+	long i;
+
+	genbuf_printf(&b, L"{vbox[root] @style_normal:fg=white", 0, 0);
+	for (i=0; i<n; i++)
+		genbuf_printf(&b, L" {label[l%ld] .expand:0 text[v%ld]:\"item text\"}", i, i);
+	genbuf_printf(&b, L"}", 0, 0);
+
+	return b.text;
+}
+
+wchar_t *bench_gen_list(long n)
+{
+	struct genbuf b = { 0, 0, 0 };
+	long i;
+
+	genbuf_printf(&b, L"{vbox {list[list] style_focus:attr=reverse style_normal:fg=white", 0, 0);
+	for (i=0; i<n; i++)
+		genbuf_printf(&b, L" {listitem text:\"list item %ld of %ld\"}", i, n);
+	genbuf_printf(&b, L"}}", 0, 0);
+
+	return b.text;
+}
+
+/* a square table with n cells (at most 30x30, see wt_table.c) */
+wchar_t *bench_gen_table(long n)
+{
+	struct genbuf b = { 0, 0, 0 };
+	long cols = 1, i;
+
+	while ((cols+1) * (cols+1) <= n && cols < 29)
+		cols++;
+
+	genbuf_printf(&b, L"{table", 0, 0);
+	for (i=0; i<cols*cols; i++) {
+		if (i && i % cols == 0)
+			genbuf_printf(&b, L" {tablebr}", 0, 0);
+		genbuf_printf(&b, L" {label .border:lrtb text:\"c%ld/%ld\"}", i / cols, i % cols);
+	}
+	genbuf_printf(&b, L"}", 0, 0);
+
+	return b.text;
+}
+
+struct stfl_screen *bench_screen;
+
+/*
+ * A curses screen which is not connected to a tty. Everything which is
+ * written to it ends up in /dev/null.
+ */
+WINDOW *bench_screen_open()
+{
+	const char *term = getenv("TERM");
+	int in_fd = open("/dev/null", O_RDONLY);
+	int out_fd = open("/dev/null", O_WRONLY);
+
+	setenv("LINES", "200", 0);
+	setenv("COLUMNS", "200", 0);
+
+	bench_screen = stfl_screen_create(in_fd, out_fd, term && *term ? term : "xterm");
+	close(in_fd);
+	close(out_fd);
+
+	if (!bench_screen)
+		return 0;
+
+	/* the benchmarks draw directly, leave it the current screen */
+	stfl_screen_lock(bench_screen);
+	stfl_screen_unlock();
+	return stdscr;
+}
+
+void bench_screen_close()
+{
+	stfl_screen_free(bench_screen);
+	bench_screen = 0;
+}
+
+/* the same as stfl_run(f, -3), but on the headless screen */
+void bench_prepare_draw(struct stfl_form *f, WINDOW *win)
+{
+	stfl_stats_current = f->stats;
+	bench_screen->colorpair_counter = 1;
+	stfl_widget_prepare(f->root, f);
+
+	getbegyx(win, f->root->y, f->root->x);
+	getmaxyx(win, f->root->h, f->root->w);
+
+	werase(win);
+	stfl_widget_draw(f->root, f, win);
+	wnoutrefresh(win);
+	stfl_stats_current = 0;
+}
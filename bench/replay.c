@@ -0,0 +1,310 @@
+/*
+ *  STFL - The Structured Terminal Forms Language/Library
+ *  Copyright (C) 2006, 2007  Clifford Wolf <clifford@clifford.at>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301 USA
+ *
+ *  replay.c: Replay a session recorded with stfl_record_start()
+ *
+ *  The recorded API calls are made again at full speed against a headless
+ *  curses screen. Before every stfl_run() the key which was read by that
+ *  call in the recording is pushed back into the curses input queue, runs
+ *  which timed out see an empty input and time out immediately.
+ */
+
+#include "stfl_internals.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+
+struct record {
+	long long time_ns;
+	char op[16];
+	int id;
+	long long num[2];
+	int nnum;
+	wchar_t *str[3];
+	int nstr;
+	int consumed;
+};
+
+static struct record *records;
+static int records_num;
+
+static struct stfl_form **forms;
+static int forms_num;
+
+static long long *run_ns;
+static int run_ns_num;
+
+static int verbose, show_stats;
+
+static int utf8_char(const char **p)
+{
+	const unsigned char *s = (const unsigned char *)*p;
+	int ch, len, i;
+
+	if (s[0] < 0x80)
+		ch = s[0], len = 1;
+	else if ((s[0] & 0xe0) == 0xc0)
+		ch = s[0] & 0x1f, len = 2;
+	else if ((s[0] & 0xf0) == 0xe0)
+		ch = s[0] & 0x0f, len = 3;
+	else
+		ch = s[0] & 0x07, len = 4;
+
+	for (i=1; i<len && s[i]; i++)
+		ch = (ch << 6) | (s[i] & 0x3f);
+
+	*p += i;
+	return ch;
+}
+
+static wchar_t *parse_string(const char **p)
+{
+	int len = 0, size = 64;
+	wchar_t *str = malloc(size * sizeof(wchar_t));
+
+	for ((*p)++; **p && **p != '"'; len++) {
+		if (len+2 > size)
+			str = realloc(str, (size *= 2) * sizeof(wchar_t));
+		if (**p == '\\' && (*p)[1] == 'x') {
+			char hex[3] = { (*p)[2], (*p)[3], 0 };
+			str[len] = strtol(hex, 0, 16);
+			*p += 4;
+		} else if (**p == '\\') {
+			str[len] = (*p)[1];
+			*p += 2;
+		} else
+			str[len] = utf8_char(p);
+	}
+
+	if (**p == '"')
+		(*p)++;
+	str[len] = 0;
+	return str;
+}
+
+static int parse_line(const char *line, struct record *r)
+{
+	int n;
+
+	memset(r, 0, sizeof(struct record));
+
+	if (sscanf(line, "%lld %15s %d%n", &r->time_ns, r->op, &r->id, &n) != 3)
+		return 0;
+
+	for (line += n; *line; ) {
+		while (*line == ' ' || *line == '\n')
+			line++;
+		if (*line == '"' && r->nstr < 3)
+			r->str[r->nstr++] = parse_string(&line);
+		else if (*line == '-' && (line[1] == ' ' || line[1] == '\n' || !line[1]) && r->nstr < 3)
+			r->str[r->nstr++] = 0, line++;
+		else if (*line && r->nnum < 2)
+			r->num[r->nnum++] = strtoll(line, (char **)&line, 10);
+		else if (*line)
+			return 0;
+	}
+
+	return 1;
+}
+
+static int load(const char *filename)
+{
+	FILE *f = fopen(filename, "r");
+	char *line = 0;
+	size_t size = 0;
+	int lineno = 0;
+
+	if (!f) {
+		perror(filename);
+		return 0;
+	}
+
+	while (getline(&line, &size, f) > 0) {
+		lineno++;
+		if (lineno == 1) {
+			if (strcmp(line, "STFL-RECORD 1\n")) {
+				fprintf(stderr, "%s: not an STFL session recording\n", filename);
+				return 0;
+			}
+			continue;
+		}
+		records = realloc(records, (records_num+1) * sizeof(struct record));
+		if (!parse_line(line, &records[records_num])) {
+			fprintf(stderr, "%s:%d: can't parse record\n", filename, lineno);
+			continue;
+		}
+		records_num++;
+	}
+
+	free(line);
+	fclose(f);
+	return 1;
+}
+
+static struct stfl_form *form(int id)
+{
+	return id > 0 && id < forms_num ? forms[id] : 0;
+}
+
+/* push the key read by the run at index i back into the input queue */
+static void unget_key(int i)
+{
+	int id = records[i].id, j;
+
+	for (j=i+1; j<records_num; j++) {
+		struct record *r = &records[j];
+		if (r->id != id)
+			continue;
+		if (!strcmp(r->op, "run"))
+			return;
+		if (!strcmp(r->op, "key") && !r->consumed) {
+			r->consumed = 1;
+			if (r->num[0] < 0)
+				return;
+			if (r->num[1])
+				ungetch(r->num[0]);
+			else
+				unget_wch(r->num[0]);
+			return;
+		}
+	}
+}
+
+static void print_stats(int id)
+{
+	const wchar_t *text = stfl_stats(forms[id]);
+	printf("--- stats for form %d ---\n%ls", id, text ? text : L"");
+}
+
+static void replay(int i)
+{
+	struct record *r = &records[i];
+	struct stfl_form *f = form(r->id);
+
+	if (!strcmp(r->op, "create")) {
+		if (r->id >= forms_num) {
+			forms = realloc(forms, (r->id+1) * sizeof(struct stfl_form *));
+			memset(forms + forms_num, 0, (r->id+1-forms_num) * sizeof(struct stfl_form *));
+			forms_num = r->id+1;
+		}
+		forms[r->id] = stfl_create(r->str[0]);
+		stfl_screen_attach(forms[r->id], bench_screen);
+		if (show_stats)
+			stfl_stats_enable(forms[r->id], 1);
+		return;
+	}
+
+	if (!strcmp(r->op, "redraw")) {
+		stfl_redraw();
+		return;
+	}
+
+	/* a reset would end the headless screen */
+	if (!strcmp(r->op, "reset") || !f)
+		return;
+
+	if (!strcmp(r->op, "run")) {
+		unget_key(i);
+		long long t = bench_now_ns();
+		const wchar_t *event = stfl_run(f, r->num[0]);
+		t = bench_now_ns() - t;
+		run_ns = realloc(run_ns, (run_ns_num+1) * sizeof(long long));
+		run_ns[run_ns_num++] = t;
+		if (verbose)
+			printf("run %d %lld: %lld ns%s%ls\n", r->id, r->num[0], t,
+					event ? " event " : "", event ? event : L"");
+	}
+	else if (!strcmp(r->op, "set"))
+		stfl_set(f, r->str[0], r->str[1]);
+	else if (!strcmp(r->op, "set_focus"))
+		stfl_set_focus(f, r->str[0]);
+	else if (!strcmp(r->op, "modify"))
+		stfl_modify(f, r->str[0], r->str[1], r->str[2]);
+	else if (!strcmp(r->op, "apply_delta"))
+		stfl_apply_delta(f, r->str[0]);
+	else if (!strcmp(r->op, "free")) {
+		if (show_stats)
+			print_stats(r->id);
+		stfl_free(f);
+		forms[r->id] = 0;
+	}
+}
+
+static int cmp_ns(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+	const char *filename = 0;
+	long long total = 0;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-v"))
+			verbose = 1;
+		else if (!strcmp(argv[i], "-s"))
+			show_stats = 1;
+		else
+			filename = argv[i];
+	}
+
+	if (!filename) {
+		fprintf(stderr, "Usage: %s [-v] [-s] recording\n", argv[0]);
+		return 1;
+	}
+
+	if (!setlocale(LC_ALL, "C.UTF-8"))
+		setlocale(LC_ALL, "");
+
+	if (!load(filename))
+		return 1;
+
+	if (!bench_screen_open()) {
+		fprintf(stderr, "Can't open a headless curses screen (check $TERM).\n");
+		return 1;
+	}
+
+	for (i=0; i<records_num; i++)
+		replay(i);
+
+	for (i=1; i<forms_num; i++)
+		if (forms[i] && show_stats)
+			print_stats(i);
+
+	bench_screen_close();
+
+	qsort(run_ns, run_ns_num, sizeof(long long), cmp_ns);
+	for (i=0; i<run_ns_num; i++)
+		total += run_ns[i];
+
+	printf("%d records, %d runs, %.3f ms", records_num, run_ns_num, total / 1000000.0);
+	if (run_ns_num)
+		printf(", per run p50 %lld ns, p90 %lld ns, p99 %lld ns, max %lld ns",
+				run_ns[run_ns_num * 50 / 100], run_ns[run_ns_num * 90 / 100],
+				run_ns[run_ns_num * 99 / 100], run_ns[run_ns_num-1]);
+	printf("\n");
+
+	return 0;
+}
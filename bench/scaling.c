@@ -0,0 +1,290 @@
+/*
+ *  STFL - The Structured Terminal Forms Language/Library
+ *  Copyright (C) 2006, 2007  Clifford Wolf <clifford@clifford.at>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301 USA
+ *
+ *  scaling.c: Check that operations on large trees scale linearly
+ *
+ *  Every case does O(n) work on a tree with n widgets and is run for
+ *  n = 1k, 10k and 100k. When the time or the number of allocations grows
+ *  much faster than n between two steps the case fails and the program
+ *  exits with a non-zero status.
+ */
+
+#include "bench.h"
+#include "stfl_compat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+
+/* a factor of 10 in n may cost up to this much (quadratic would be 100) */
+#define MAX_TIME_RATIO  30.0
+#define MAX_ALLOC_RATIO 15.0
+
+/* step timings below this are too noisy to be compared */
+#define MIN_COMPARABLE_NS 200000LL
+
+static struct stfl_form *form;
+static struct stfl_widget *widget;
+
+static void setup_list(long n)
+{
+	wchar_t *text = bench_gen_list(n);
+	struct stfl_widget *c;
+	long i = 0;
+
+	form = stfl_create(text);
+	free(text);
+
+	widget = stfl_widget_by_name(form->root, L"list");
+	for (c = widget->first_child; c; c = c->next_sibling) {
+		wchar_t name[32];
+		swprintf(name, 32, L"i%ld", i++);
+		c->name = compat_wcsdup(name);
+	}
+}
+
+static void setup_inputs(long n)
+{
+	struct stfl_widget *c;
+	long i;
+
+	form = stfl_create(L"{vbox}");
+	widget = form->root;
+
+	for (i=0; i<n; i++) {
+		c = stfl_widget_new(L"input");
+		c->parent = widget;
+		c->prev_sibling = widget->last_child;
+		if (widget->last_child)
+			widget->last_child->next_sibling = c;
+		else
+			widget->first_child = c;
+		widget->last_child = c;
+	}
+
+	form->current_focus_id = widget->last_child->id;
+}
+
+static void setup_textedit(long n)
+{
+	struct stfl_widget *c;
+	long i;
+
+	form = stfl_create(L"{textedit[edit] cursor_x:0 cursor_y:1}");
+	widget = form->root;
+
+	for (i=0; i<n; i++) {
+		c = stfl_widget_new(L"listitem");
+		c->parent = widget;
+		c->prev_sibling = widget->last_child;
+		if (widget->last_child)
+			widget->last_child->next_sibling = c;
+		else
+			widget->first_child = c;
+		widget->last_child = c;
+	}
+}
+
+static void setup_labels(long n)
+{
+	wchar_t *text = bench_gen_labels(n);
+	form = stfl_create(text);
+	free(text);
+}
+
+static void teardown_form()
+{
+	stfl_free(form);
+	form = 0;
+}
+
+static void op_modify_delete(long n)
+{
+	long i;
+
+	for (i=0; i<n; i++) {
+		wchar_t name[32];
+		swprintf(name, 32, L"i%ld", i);
+		stfl_modify(form, name, L"delete", 0);
+	}
+}
+
+static void op_free_last(long n)
+{
+	while (widget->last_child)
+		stfl_widget_free(widget->last_child);
+}
+
+static void op_replace_inner(long n)
+{
+	stfl_modify(form, L"list", L"replace_inner", L"{list}");
+}
+
+static void op_modify_append(long n)
+{
+	long i;
+
+	for (i=0; i<n; i++)
+		stfl_modify(form, L"list", L"append", L"{listitem text:new}");
+}
+
+static void op_focus_prev(long n)
+{
+	struct stfl_widget *fw = widget->last_child;
+
+	while (stfl_focus_prev(widget, fw, form))
+		fw = fw->prev_sibling;
+}
+
+static void op_focus_next(long n)
+{
+	struct stfl_widget *fw = widget->first_child;
+
+	form->current_focus_id = fw->id;
+	while (stfl_focus_next(widget, fw, form))
+		fw = fw->next_sibling;
+}
+
+static void op_textedit_backspace(long n)
+{
+	long i;
+
+	for (i=1; i<n; i++) {
+		stfl_widget_setkv_int(widget, L"cursor_y", 1);
+		widget->type->f_process(widget, widget, form, 127, 0);
+	}
+}
+
+static void op_textedit_enter(long n)
+{
+	long i;
+
+	for (i=1; i<n; i++) {
+		stfl_widget_setkv_int(widget, L"cursor_y", 0);
+		widget->type->f_process(widget, widget, form, L'\r', 0);
+	}
+}
+
+static void op_dump(long n)
+{
+	stfl_dump(form, 0, L"", 0);
+}
+
+static void op_text(long n)
+{
+	stfl_text(form, 0);
+}
+
+static struct bench_case cases[] = {
+	{ "modify_delete",      0, setup_list,     op_modify_delete,      teardown_form },
+	{ "free_last_child",    0, setup_list,     op_free_last,          teardown_form },
+	{ "replace_inner",      0, setup_list,     op_replace_inner,      teardown_form },
+	{ "modify_append",      0, setup_list,     op_modify_append,      teardown_form },
+	{ "focus_prev",         0, setup_inputs,   op_focus_prev,         teardown_form },
+	{ "focus_next",         0, setup_inputs,   op_focus_next,         teardown_form },
+	{ "textedit_backspace", 0, setup_textedit, op_textedit_backspace, teardown_form },
+	{ "textedit_enter",     0, setup_textedit, op_textedit_enter,     teardown_form },
+	{ "dump",               0, setup_labels,   op_dump,               teardown_form },
+	{ "text",               0, setup_list,     op_text,               teardown_form },
+	{ 0 }
+};
+
+static long sizes[] = { 1000, 10000, 100000, 0 };
+
+/* runs are only repeated while they are fast, slow steps are measured once */
+#define MEASURE_BUDGET_NS 500000000LL
+
+/* best of a few runs, the setup is not part of the measurement */
+static void measure(struct bench_case *c, long n, long long *ns, unsigned long *allocs)
+{
+	long long spent = 0;
+	int i;
+
+	for (i=0; i<5 && spent < MEASURE_BUDGET_NS; i++) {
+		c->f_setup(n);
+
+		unsigned long count = bench_alloc_count;
+		long long t = bench_now_ns();
+		c->f_op(n);
+		t = bench_now_ns() - t;
+		spent += t;
+
+		if (i == 0 || t < *ns)
+			*ns = t;
+		*allocs = bench_alloc_count - count;
+
+		c->f_teardown();
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *filter = argc > 1 ? argv[1] : 0;
+	int failed = 0;
+	int i, j;
+
+	if (!setlocale(LC_ALL, "C.UTF-8"))
+		setlocale(LC_ALL, "");
+
+	printf("%-20s %8s %12s %12s %10s %10s\n", "case", "n", "ms", "allocs", "t-ratio", "a-ratio");
+
+	for (i=0; cases[i].name; i++)
+	{
+		long long last_ns = 0;
+		unsigned long last_allocs = 0;
+		int case_failed = 0;
+
+		if (filter && !strstr(cases[i].name, filter))
+			continue;
+
+		for (j=0; sizes[j]; j++)
+		{
+			long long ns = 0;
+			unsigned long allocs;
+			double t_ratio = 0, a_ratio = 0;
+
+			measure(&cases[i], sizes[j], &ns, &allocs);
+
+			if (j > 0) {
+				t_ratio = (double)ns / (last_ns > 0 ? last_ns : 1);
+				a_ratio = (double)allocs / (last_allocs > 0 ? last_allocs : 1);
+
+				if (last_ns >= MIN_COMPARABLE_NS && t_ratio > MAX_TIME_RATIO)
+					case_failed = 1;
+				if (last_allocs > 0 && a_ratio > MAX_ALLOC_RATIO)
+					case_failed = 1;
+			}
+
+			printf("%-20s %8ld %12.3f %12lu %10.1f %10.1f\n", cases[i].name, sizes[j],
+					ns / 1000000.0, allocs, t_ratio, a_ratio);
+			fflush(stdout);
+
+			last_ns = ns;
+			last_allocs = allocs;
+		}
+
+		if (case_failed) {
+			printf("%-20s FAILED: grows faster than linear\n", cases[i].name);
+			failed = 1;
+		}
+	}
+
+	return failed;
+}
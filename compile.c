@@ -0,0 +1,737 @@
+/*
+ *  STFL - The Structured Terminal Forms Language/Library
+ *  Copyright (C) 2006, 2007  Clifford Wolf <clifford@clifford.at>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301 USA
+ *
+ *  compile.c: Binary form and static tables of STFL widget trees
+ */
+
+#include "stfl_internals.h"
+#include "stfl_compat.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wctype.h>
+
+/*
+ * A compiled tree is laid out as:
+ *
+ *   header | strings[nstrings] | widgets[nwidgets] | kvs[nkvs] | pool
+ *
+ * All strings (type names, widget names and classes, keys, values and
+ * variable names) are stored only once in the pool as NUL terminated wide
+ * character strings and referenced by their index in the string table.
+ * Widgets are stored in pre-order, each one followed by its children. The
+ * kvs of every widget are stored in the order in which they were set.
+ *
+ * The format uses the native byte order and wchar_t size, files compiled on
+ * a different platform are rejected.
+ *
+ * A snapshot of a form uses the same layout with a larger header and two
+ * more arrays before the pool:
+ *
+ *   header | strings | widgets | kvs | state[nwidgets] | events[nevents] | pool
+ *
+ * The state has the unparsed source of lazy subtrees and the geometry of
+ * every widget, events are string indexes of the queued events. Lazy
+ * subtrees are not expanded for a snapshot.
+ */
+
+#define BIN_MAGIC	"STFLBIN1"
+#define SNAP_MAGIC	"STFLSNP1"
+#define BIN_BYTEORDER	0x01020304
+#define BIN_NONE	0xffffffff
+#define BIN_SETFOCUS	1
+
+struct bin_header {
+	char magic[8];
+	uint32_t byteorder, wchar_size;
+	uint32_t nstrings, nwidgets, nkvs, pool_len;
+};
+
+struct bin_string {
+	uint32_t offset, length;
+};
+
+struct bin_widget {
+	uint32_t type, name, cls, flags, nkvs, nchildren;
+};
+
+struct bin_kv {
+	uint32_t key, value, name;
+};
+
+struct snap_header {
+	struct bin_header bin;
+	uint32_t focus, cursor_x, cursor_y, nevents;
+};
+
+struct snap_widget {
+	uint32_t lazy_src, allow_focus;
+	int32_t x, y, w, h, min_w, min_h, cur_x, cur_y;
+	int32_t parser_indent;
+};
+
+struct encoder {
+	struct bin_string *strings;
+	uint32_t nstrings, strings_size;
+	uint32_t *hash, hash_size, nhashed;
+	wchar_t *pool;
+	size_t pool_len, pool_size;
+	struct bin_widget *widgets;
+	uint32_t nwidgets, widgets_size;
+	struct bin_kv *kvs;
+	uint32_t nkvs, kvs_size;
+	struct snap_widget *state;
+	int snapshot, focus_id;
+	uint32_t focus;
+};
+
+static void encoder_free(struct encoder *e)
+{
+	free(e->strings);
+	free(e->hash);
+	free(e->pool);
+	free(e->widgets);
+	free(e->kvs);
+	free(e->state);
+}
+
+static uint32_t hash_string(const wchar_t *s)
+{
+	uint32_t h = 2166136261u;
+	while (*s)
+		h = (h ^ (uint32_t)*(s++)) * 16777619u;
+	return h;
+}
+
+static void rehash(struct encoder *e)
+{
+	uint32_t *old = e->hash, old_size = e->hash_size, i, j;
+
+	e->hash_size = old_size ? old_size * 2 : 256;
+	e->hash = calloc(e->hash_size, sizeof(uint32_t));
+
+	for (i = 0; i < old_size; i++) {
+		if (!old[i])
+			continue;
+		j = hash_string(e->pool + e->strings[old[i]-1].offset) & (e->hash_size-1);
+		while (e->hash[j])
+			j = (j+1) & (e->hash_size-1);
+		e->hash[j] = old[i];
+	}
+
+	free(old);
+}
+
+/* adds a string to the pool without looking for an equal one */
+static uint32_t pool_add(struct encoder *e, const wchar_t *s)
+{
+	size_t len;
+
+	if (!s)
+		return BIN_NONE;
+
+	len = wcslen(s);
+	while (e->pool_len + len + 1 > e->pool_size) {
+		e->pool_size = e->pool_size ? e->pool_size * 2 : 4096;
+		e->pool = realloc(e->pool, e->pool_size * sizeof(wchar_t));
+	}
+	wmemcpy(e->pool + e->pool_len, s, len + 1);
+
+	if (e->nstrings == e->strings_size) {
+		e->strings_size = e->strings_size ? e->strings_size * 2 : 256;
+		e->strings = realloc(e->strings, e->strings_size * sizeof(struct bin_string));
+	}
+	e->strings[e->nstrings].offset = e->pool_len;
+	e->strings[e->nstrings].length = len;
+	e->pool_len += len + 1;
+
+	return e->nstrings++;
+}
+
+static uint32_t intern(struct encoder *e, const wchar_t *s)
+{
+	uint32_t i;
+
+	if (!s)
+		return BIN_NONE;
+
+	if (e->nhashed*2 >= e->hash_size)
+		rehash(e);
+
+	i = hash_string(s) & (e->hash_size-1);
+	while (e->hash[i]) {
+		struct bin_string *bs = &e->strings[e->hash[i]-1];
+		if (!wcscmp(e->pool + bs->offset, s))
+			return e->hash[i]-1;
+		i = (i+1) & (e->hash_size-1);
+	}
+
+	e->hash[i] = e->nstrings + 1;
+	e->nhashed++;
+	return pool_add(e, s);
+}
+
+/*
+ * Names and values are mostly unique, a snapshot is written faster
+ * without looking them up. Compiled trees are kept as small as possible.
+ */
+static uint32_t intern_value(struct encoder *e, const wchar_t *s)
+{
+	return e->snapshot ? pool_add(e, s) : intern(e, s);
+}
+
+static void encode_widget(struct encoder *e, struct stfl_widget *w)
+{
+	struct bin_widget *bw;
+	struct stfl_widget *c;
+	struct stfl_kv *kv;
+	uint32_t idx, nkvs = 0, nchildren = 0;
+
+	if (w->lazy_src && !e->snapshot)
+		stfl_widget_expand(w);
+
+	for (kv = w->kv_list; kv; kv = kv->next)
+		nkvs++;
+	for (c = w->first_child; c; c = c->next_sibling)
+		nchildren++;
+
+	if (e->nwidgets == e->widgets_size) {
+		e->widgets_size = e->widgets_size ? e->widgets_size * 2 : 256;
+		e->widgets = realloc(e->widgets, e->widgets_size * sizeof(struct bin_widget));
+		if (e->snapshot)
+			e->state = realloc(e->state, e->widgets_size * sizeof(struct snap_widget));
+	}
+	while (e->nkvs + nkvs > e->kvs_size) {
+		e->kvs_size = e->kvs_size ? e->kvs_size * 2 : 256;
+		e->kvs = realloc(e->kvs, e->kvs_size * sizeof(struct bin_kv));
+	}
+
+	bw = &e->widgets[e->nwidgets++];
+	bw->type = intern(e, w->type->name);
+	bw->name = intern_value(e, w->name);
+	bw->cls = intern(e, w->cls);
+	bw->flags = w->setfocus ? BIN_SETFOCUS : 0;
+	bw->nkvs = nkvs;
+	bw->nchildren = nchildren;
+
+	if (e->snapshot) {
+		struct snap_widget *sw = &e->state[e->nwidgets-1];
+		sw->lazy_src = intern_value(e, w->lazy_src);
+		sw->allow_focus = w->allow_focus;
+		sw->x = w->x, sw->y = w->y, sw->w = w->w, sw->h = w->h;
+		sw->min_w = w->min_w, sw->min_h = w->min_h;
+		sw->cur_x = w->cur_x, sw->cur_y = w->cur_y;
+		sw->parser_indent = w->parser_indent;
+		if (w->id == e->focus_id)
+			e->focus = e->nwidgets-1;
+	}
+
+	/* kv_list has the most recently set kv first */
+	idx = e->nkvs + nkvs;
+	for (kv = w->kv_list; kv; kv = kv->next) {
+		struct bin_kv *bk = &e->kvs[--idx];
+		bk->key = intern(e, kv->key);
+		bk->value = intern_value(e, kv->value);
+		bk->name = intern_value(e, kv->name);
+	}
+	e->nkvs += nkvs;
+
+	for (c = w->first_child; c; c = c->next_sibling)
+		encode_widget(e, c);
+}
+
+static char *put(char *p, const void *data, size_t size)
+{
+	memcpy(p, data, size);
+	return p + size;
+}
+
+static size_t encoder_size(struct encoder *e)
+{
+	return e->nstrings * sizeof(struct bin_string) + e->nwidgets * sizeof(struct bin_widget) +
+			e->nkvs * sizeof(struct bin_kv) + e->pool_len * sizeof(wchar_t);
+}
+
+static void encoder_header(struct encoder *e, struct bin_header *h, const char *magic)
+{
+	memcpy(h->magic, magic, 8);
+	h->byteorder = BIN_BYTEORDER;
+	h->wchar_size = sizeof(wchar_t);
+	h->nstrings = e->nstrings;
+	h->nwidgets = e->nwidgets;
+	h->nkvs = e->nkvs;
+	h->pool_len = e->pool_len;
+}
+
+void *stfl_binary_encode(struct stfl_widget *w, size_t *size)
+{
+	struct encoder e;
+	struct bin_header h;
+	char *data, *p;
+
+	memset(&e, 0, sizeof(e));
+	encode_widget(&e, w);
+	encoder_header(&e, &h, BIN_MAGIC);
+
+	*size = sizeof(h) + encoder_size(&e);
+	p = data = malloc(*size);
+
+	p = put(p, &h, sizeof(h));
+	p = put(p, e.strings, e.nstrings * sizeof(struct bin_string));
+	p = put(p, e.widgets, e.nwidgets * sizeof(struct bin_widget));
+	p = put(p, e.kvs, e.nkvs * sizeof(struct bin_kv));
+	put(p, e.pool, e.pool_len * sizeof(wchar_t));
+
+	encoder_free(&e);
+	return data;
+}
+
+/* the caller must hold the form lock */
+void *stfl_snapshot_encode(struct stfl_form *f, size_t *size)
+{
+	struct encoder e;
+	struct snap_header h;
+	struct stfl_event *ev;
+	uint32_t nevents = 0, i = 0;
+	char *data, *p;
+
+	memset(&e, 0, sizeof(e));
+	e.snapshot = 1;
+	e.focus_id = f->current_focus_id;
+	e.focus = BIN_NONE;
+	encode_widget(&e, f->root);
+
+	for (ev = f->event_queue; ev; ev = ev->next)
+		nevents++;
+
+	uint32_t events[nevents + 1];
+	for (ev = f->event_queue; ev; ev = ev->next)
+		events[i++] = intern(&e, ev->event);
+
+	encoder_header(&e, &h.bin, SNAP_MAGIC);
+	h.focus = e.focus;
+	h.cursor_x = f->cursor_x;
+	h.cursor_y = f->cursor_y;
+	h.nevents = nevents;
+
+	*size = sizeof(h) + encoder_size(&e) + e.nwidgets * sizeof(struct snap_widget) +
+			nevents * sizeof(uint32_t);
+	p = data = malloc(*size);
+
+	p = put(p, &h, sizeof(h));
+	p = put(p, e.strings, e.nstrings * sizeof(struct bin_string));
+	p = put(p, e.widgets, e.nwidgets * sizeof(struct bin_widget));
+	p = put(p, e.kvs, e.nkvs * sizeof(struct bin_kv));
+	p = put(p, e.state, e.nwidgets * sizeof(struct snap_widget));
+	p = put(p, events, nevents * sizeof(uint32_t));
+	put(p, e.pool, e.pool_len * sizeof(wchar_t));
+
+	encoder_free(&e);
+	return data;
+}
+
+static void put_literal(FILE *f, const wchar_t *s)
+{
+	fputs("L\"", f);
+
+	for (; *s; s++) {
+		unsigned int ch = *s;
+		if (ch == '"' || ch == '\\' || ch == '?')
+			fprintf(f, "\\%c", ch);
+		else if (ch >= 0x20 && ch < 0x7f)
+			fputc(ch, f);
+		else {
+			fprintf(f, "\\x%x", ch);
+			/* a hex escape would swallow the following hex digits */
+			if (iswxdigit(s[1]) && s[1] < 0x80)
+				fputs("\" L\"", f);
+		}
+	}
+
+	fputc('"', f);
+}
+
+static void put_ref(FILE *f, const char *prefix, uint32_t idx)
+{
+	if (idx == BIN_NONE)
+		fputs("0", f);
+	else
+		fprintf(f, "%s_s%u", prefix, idx);
+}
+
+/*
+ * Writes C source with the tree as static tables (in the same order as the
+ * binary form) and a function <prefix>_create() which creates a form from
+ * them using stfl_create_static().
+ */
+char *stfl_static_encode(struct stfl_widget *w, const char *prefix, const char *source)
+{
+	struct encoder e;
+	char *text = 0;
+	size_t text_size;
+	uint32_t i;
+	FILE *f;
+
+	memset(&e, 0, sizeof(e));
+	encode_widget(&e, w);
+
+	f = open_memstream(&text, &text_size);
+
+	fprintf(f, "/* Generated by stflc from %s, do not edit. */\n\n", source);
+	fprintf(f, "#include <stfl.h>\n\n");
+
+	for (i = 0; i < e.nstrings; i++) {
+		fprintf(f, "static const wchar_t %s_s%u[] = ", prefix, i);
+		put_literal(f, e.pool + e.strings[i].offset);
+		fputs(";\n", f);
+	}
+
+	fprintf(f, "\nstatic const struct stfl_static_kv %s_kvs[] = {\n", prefix);
+	for (i = 0; i < e.nkvs; i++) {
+		fputs("\t{ ", f);
+		put_ref(f, prefix, e.kvs[i].key);
+		fputs(", ", f);
+		put_ref(f, prefix, e.kvs[i].value);
+		fputs(", ", f);
+		put_ref(f, prefix, e.kvs[i].name);
+		fputs(" },\n", f);
+	}
+	if (e.nkvs == 0)
+		fputs("\t{ 0, 0, 0 }\n", f);
+	fputs("};\n", f);
+
+	fprintf(f, "\nstatic const struct stfl_static_widget %s_widgets[] = {\n", prefix);
+	for (i = 0; i < e.nwidgets; i++) {
+		fputs("\t{ ", f);
+		put_ref(f, prefix, e.widgets[i].type);
+		fputs(", ", f);
+		put_ref(f, prefix, e.widgets[i].name);
+		fputs(", ", f);
+		put_ref(f, prefix, e.widgets[i].cls);
+		fprintf(f, ", %d, %u, %u },\n", e.widgets[i].flags & BIN_SETFOCUS,
+				e.widgets[i].nkvs, e.widgets[i].nchildren);
+	}
+	fputs("};\n", f);
+
+	fprintf(f, "\nstruct stfl_form *%s_create()\n{\n", prefix);
+	fprintf(f, "\treturn stfl_create_static(%s_widgets, %s_kvs);\n}\n", prefix, prefix);
+
+	fclose(f);
+	encoder_free(&e);
+
+	return text;
+}
+
+int stfl_binary_check(const void *data, size_t size)
+{
+	return size >= sizeof(struct bin_header) && !memcmp(data, BIN_MAGIC, 8);
+}
+
+struct decoder {
+	const struct bin_header *h;
+	const struct bin_string *strings;
+	const struct bin_widget *widgets;
+	const struct bin_kv *kvs;
+	const struct snap_widget *state;
+	const uint32_t *events;
+	const wchar_t *pool;
+};
+
+static wchar_t *get_string(struct decoder *d, uint32_t idx)
+{
+	const struct bin_string *bs = &d->strings[idx];
+	wchar_t *s = malloc((bs->length + 1) * sizeof(wchar_t));
+	wmemcpy(s, d->pool + bs->offset, bs->length + 1);
+	return s;
+}
+
+static struct stfl_widget_type *get_type(const wchar_t *name)
+{
+	int i;
+
+	for (i = 0; stfl_widget_types[i]; i++)
+		if (!wcscmp(stfl_widget_types[i]->name, name))
+			return stfl_widget_types[i];
+	return 0;
+}
+
+/*
+ * Builds a tree from widgets in pre-order, each one with the number of its
+ * children. The tree is complete when the root and all its children have
+ * been added.
+ */
+struct builder {
+	struct stfl_widget *root;
+	struct { struct stfl_widget *w; uint32_t left; } *stack;
+	uint32_t depth, stack_size;
+};
+
+static int builder_done(struct builder *b)
+{
+	return b->root && b->depth == 0;
+}
+
+static struct stfl_widget *builder_add(struct builder *b, struct stfl_widget_type *t, int setfocus, uint32_t nchildren)
+{
+	struct stfl_widget *w = stfl_widget_new_type(t, setfocus);
+
+	if (b->depth > 0) {
+		stfl_widget_link_child(b->stack[b->depth-1].w, w, 0);
+		b->stack[b->depth-1].left--;
+	} else
+		b->root = w;
+
+	if (nchildren > 0) {
+		if (b->depth == b->stack_size) {
+			b->stack_size = b->stack_size ? b->stack_size * 2 : 16;
+			b->stack = realloc(b->stack, b->stack_size * sizeof(*b->stack));
+		}
+		b->stack[b->depth].w = w;
+		b->stack[b->depth++].left = nchildren;
+	}
+
+	while (b->depth > 0 && b->stack[b->depth-1].left == 0)
+		b->depth--;
+
+	return w;
+}
+
+/* checks the header and all string references, returns 0 on success */
+static int check(struct decoder *d, const void *data, size_t size, int snapshot)
+{
+	const struct bin_header *h = data;
+	const struct snap_header *sh = data;
+	size_t header_size = snapshot ? sizeof(struct snap_header) : sizeof(struct bin_header);
+	uint32_t i;
+
+	if (size < header_size || memcmp(data, snapshot ? SNAP_MAGIC : BIN_MAGIC, 8) ||
+			((uintptr_t)data % sizeof(uint32_t)) != 0)
+		return -1;
+
+	if (h->byteorder != BIN_BYTEORDER || h->wchar_size != sizeof(wchar_t))
+		return -1;
+
+	size -= header_size;
+	if (h->nstrings > size / sizeof(struct bin_string))
+		return -1;
+	size -= h->nstrings * sizeof(struct bin_string);
+	if (h->nwidgets > size / sizeof(struct bin_widget))
+		return -1;
+	size -= h->nwidgets * sizeof(struct bin_widget);
+	if (h->nkvs > size / sizeof(struct bin_kv))
+		return -1;
+	size -= h->nkvs * sizeof(struct bin_kv);
+	if (snapshot) {
+		if (h->nwidgets > size / sizeof(struct snap_widget))
+			return -1;
+		size -= h->nwidgets * sizeof(struct snap_widget);
+		if (sh->nevents > size / sizeof(uint32_t))
+			return -1;
+		size -= sh->nevents * sizeof(uint32_t);
+	}
+	if (h->pool_len != size / sizeof(wchar_t) || size % sizeof(wchar_t))
+		return -1;
+
+	d->h = h;
+	d->strings = (const struct bin_string *)((const char *)data + header_size);
+	d->widgets = (const struct bin_widget *)(d->strings + h->nstrings);
+	d->kvs = (const struct bin_kv *)(d->widgets + h->nwidgets);
+	d->state = snapshot ? (const struct snap_widget *)(d->kvs + h->nkvs) : 0;
+	d->events = snapshot ? (const uint32_t *)(d->state + h->nwidgets) : 0;
+	d->pool = snapshot ? (const wchar_t *)(d->events + sh->nevents) : (const wchar_t *)(d->kvs + h->nkvs);
+
+	for (i = 0; i < h->nstrings; i++) {
+		const struct bin_string *bs = &d->strings[i];
+		if (bs->offset >= h->pool_len || bs->length >= h->pool_len - bs->offset ||
+				d->pool[bs->offset + bs->length] != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int bad_string(struct decoder *d, uint32_t idx)
+{
+	return idx != BIN_NONE && idx >= d->h->nstrings;
+}
+
+/* builds the tree, with the state of a snapshot when there is one */
+static struct stfl_widget *decode_tree(struct decoder *d, uint32_t focus, struct stfl_widget **focus_widget)
+{
+	struct builder b;
+	uint32_t i, j, kv_pos = 0;
+
+	if (d->h->nwidgets == 0)
+		return 0;
+
+	memset(&b, 0, sizeof(b));
+
+	for (i = 0; i < d->h->nwidgets; i++)
+	{
+		const struct bin_widget *bw = &d->widgets[i];
+		struct stfl_widget_type *t;
+		struct stfl_widget *w;
+
+		if (bw->type >= d->h->nstrings || bad_string(d, bw->name) || bad_string(d, bw->cls) ||
+				bw->nkvs > d->h->nkvs - kv_pos || builder_done(&b))
+			goto error;
+
+		if ((t = get_type(d->pool + d->strings[bw->type].offset)) == 0)
+			goto error;
+
+		w = builder_add(&b, t, bw->flags & BIN_SETFOCUS, bw->nchildren);
+
+		if (bw->name != BIN_NONE)
+			w->name = get_string(d, bw->name);
+		if (bw->cls != BIN_NONE)
+			w->cls = get_string(d, bw->cls);
+
+		for (j = 0; j < bw->nkvs; j++) {
+			const struct bin_kv *bk = &d->kvs[kv_pos++];
+			if (bk->key >= d->h->nstrings || bk->value >= d->h->nstrings || bad_string(d, bk->name))
+				goto error;
+			struct stfl_kv *kv = stfl_widget_setkv_take(w,
+					get_string(d, bk->key), get_string(d, bk->value));
+			if (bk->name != BIN_NONE) {
+				free(kv->name);
+				kv->name = get_string(d, bk->name);
+			}
+		}
+
+		if (d->state) {
+			const struct snap_widget *sw = &d->state[i];
+			if (bad_string(d, sw->lazy_src) || (sw->lazy_src != BIN_NONE && bw->nchildren))
+				goto error;
+			if (sw->lazy_src != BIN_NONE)
+				w->lazy_src = get_string(d, sw->lazy_src);
+			w->allow_focus = sw->allow_focus;
+			w->x = sw->x, w->y = sw->y, w->w = sw->w, w->h = sw->h;
+			w->min_w = sw->min_w, w->min_h = sw->min_h;
+			w->cur_x = sw->cur_x, w->cur_y = sw->cur_y;
+			w->parser_indent = sw->parser_indent;
+			if (i == focus)
+				*focus_widget = w;
+		}
+	}
+
+	if (!builder_done(&b) || kv_pos != d->h->nkvs)
+		goto error;
+
+	free(b.stack);
+	return b.root;
+
+error:
+	if (b.root)
+		stfl_widget_free(b.root);
+	free(b.stack);
+	return 0;
+}
+
+/*
+ * The data must be aligned for 32 bit access, which is always the case for
+ * memory from malloc() or mmap(). Returns 0 if the data is not a valid
+ * compiled tree for this platform.
+ */
+struct stfl_widget *stfl_binary_decode(const void *data, size_t size)
+{
+	struct decoder d;
+
+	if (check(&d, data, size, 0) < 0)
+		return 0;
+
+	return decode_tree(&d, BIN_NONE, 0);
+}
+
+/* like stfl_binary_decode(), returns 0 if the data is not a valid snapshot */
+struct stfl_form *stfl_snapshot_decode(const void *data, size_t size)
+{
+	const struct snap_header *h = data;
+	struct stfl_widget *root, *fw = 0;
+	struct stfl_form *f;
+	struct decoder d;
+	uint32_t i;
+
+	if (check(&d, data, size, 1) < 0)
+		return 0;
+
+	for (i = 0; i < h->nevents; i++)
+		if (d.events[i] >= d.h->nstrings)
+			return 0;
+
+	if ((root = decode_tree(&d, h->focus, &fw)) == 0)
+		return 0;
+
+	f = stfl_form_new();
+	stfl_form_set_root(f, root);
+	f->current_focus_id = fw ? fw->id : 0;
+	f->cursor_x = h->cursor_x;
+	f->cursor_y = h->cursor_y;
+
+	for (i = 0; i < h->nevents; i++)
+		stfl_form_event(f, get_string(&d, d.events[i]));
+
+	return f;
+}
+
+/*
+ * Static tables are written by "stflc -c" in the same order as the binary
+ * form, but reference the strings directly. They are generated from a parsed
+ * tree, so they are trusted. Returns 0 if a widget type is unknown.
+ */
+struct stfl_widget *stfl_static_decode(const struct stfl_static_widget *widgets, const struct stfl_static_kv *kvs)
+{
+	struct builder b;
+	int i;
+
+	memset(&b, 0, sizeof(b));
+
+	do {
+		const struct stfl_static_widget *sw = widgets++;
+		struct stfl_widget_type *t = get_type(sw->type);
+		struct stfl_widget *w;
+
+		if (!t) {
+			if (b.root)
+				stfl_widget_free(b.root);
+			free(b.stack);
+			return 0;
+		}
+
+		w = builder_add(&b, t, sw->setfocus, sw->nchildren);
+
+		if (sw->name)
+			w->name = compat_wcsdup(sw->name);
+		if (sw->cls)
+			w->cls = compat_wcsdup(sw->cls);
+
+		for (i = 0; i < sw->nkvs; i++, kvs++) {
+			struct stfl_kv *kv = stfl_widget_setkv_take(w,
+					compat_wcsdup(kvs->key), compat_wcsdup(kvs->value));
+			if (kvs->name) {
+				free(kv->name);
+				kv->name = compat_wcsdup(kvs->name);
+			}
+		}
+	} while (!builder_done(&b));
+
+	free(b.stack);
+	return b.root;
+}
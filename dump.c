@@ -26,163 +26,428 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
 
-struct txtnode {
-	struct txtnode *prev;
-	wchar_t *value;
-	int len;
+/*
+ * The output is collected in one growable buffer. When there is a sink,
+ * the buffer has a fixed size and is passed to the sink whenever it is
+ * full, so the memory used does not depend on the size of the tree.
+ */
+#define TXTBUF_CHUNK 4096
+
+struct txtbuf {
+	wchar_t *text;
+	size_t len, size;
+	int (*sink)(void *ctx, const wchar_t *text, size_t len);
+	void *ctx;
+	int error;
 };
 
-static void newtxt(struct txtnode **o, const wchar_t *fmt, ...)
-		/* __attribute__ ((format (wprintf, 2, 3))) */
+static void txt_flush(struct txtbuf *b)
 {
-	struct txtnode *n = calloc(1, sizeof(struct txtnode));
-
-	n->prev = *o;
-	*o = n;
+	if (b->len && !b->error && b->sink(b->ctx, b->text, b->len) < 0)
+		b->error = 1;
+	b->len = 0;
+}
 
-	va_list ap;
-	va_start(ap, fmt);
-	wchar_t *buf = malloc(4096 * sizeof(wchar_t));
-	int buf_len = 4096;
-	while (1) {
-		int rc = vswprintf(buf, buf_len, fmt, ap);
-		if (rc < 0) {
-			free(buf);
-			buf = NULL;
-			break;
-		}
-		if ((rc + 1) < buf_len) {
-			buf = realloc(buf, (rc + 1) * sizeof(wchar_t));
-			break;
+static void txt_add(struct txtbuf *b, const wchar_t *s, size_t n)
+{
+	if (b->len + n >= b->size)
+	{
+		if (b->sink) {
+			txt_flush(b);
+			if (n >= b->size) {
+				if (!b->error && b->sink(b->ctx, s, n) < 0)
+					b->error = 1;
+				return;
+			}
+		} else {
+			while (b->len + n >= b->size)
+				b->size = b->size ? b->size * 2 : 256;
+			b->text = realloc(b->text, b->size * sizeof(wchar_t));
 		}
-		buf_len = buf_len * 2;
-		buf = realloc(buf, buf_len * sizeof(wchar_t));
 	}
-	n->value = buf;
-	if (n->value)
-		n->len = wcslen(n->value);
+
+	wmemcpy(b->text + b->len, s, n);
+	b->len += n;
+}
+
+static inline void txt_str(struct txtbuf *b, const wchar_t *s)
+{
+	txt_add(b, s, wcslen(s));
+}
+
+static inline void txt_char(struct txtbuf *b, wchar_t c)
+{
+	txt_add(b, &c, 1);
+}
+
+static wchar_t *txt_string(struct txtbuf *b)
+{
+	if (!b->text)
+		b->text = malloc(sizeof(wchar_t));
 	else
-		n->len = 0;
-	va_end(ap);
+		b->text = realloc(b->text, (b->len + 1) * sizeof(wchar_t));
+	b->text[b->len] = 0;
+	return b->text;
 }
 
-static void myquote(struct txtnode **txt, const wchar_t *text)
+/* keeps the buffer at its size, so it can be used again for the next text */
+static void txt_reuse(struct txtbuf *b, wchar_t **text, size_t *size)
 {
-	wchar_t q[2] = {L'"', 0};
-	int segment_len;
+	if (!b->text) {
+		b->size = 256;
+		b->text = malloc(b->size * sizeof(wchar_t));
+	}
+	b->text[b->len] = 0;
+	*text = b->text;
+	*size = b->size;
+}
+
+static int txt_finish(struct txtbuf *b)
+{
+	txt_flush(b);
+	free(b->text);
+	return b->error ? -1 : 0;
+}
+
+static void myquote(struct txtbuf *b, const wchar_t *text)
+{
+	wchar_t q = L'"';
+	size_t segment_len;
 
 	if (wcscspn(text, L"'") > wcscspn(text, L"\""))
-		q[0] = L'\'';
+		q = L'\'';
 
 	while (*text) {
-		segment_len = wcscspn(text, q);
-		newtxt(txt, L"%c%.*ls%c", q[0], segment_len, text, q[0]);
-		q[0] = q[0] == L'"' ? L'\'' : L'"';
+		segment_len = wcscspn(text, q == L'"' ? L"\"" : L"'");
+		txt_char(b, q);
+		txt_add(b, text, segment_len);
+		txt_char(b, q);
+		q = q == L'"' ? L'\'' : L'"';
 		text += segment_len;
 	}
 }
 
-static void mydump(struct stfl_widget *w, const wchar_t *prefix, int focus_id, struct txtnode **txt)
+static void mykv(struct stfl_kv *kv, const wchar_t *prefix, struct txtbuf *b)
+{
+	txt_char(b, L' ');
+	txt_str(b, kv->key);
+
+	if (kv->name) {
+		txt_char(b, L'[');
+		myquote(b, prefix);
+		myquote(b, kv->name);
+		txt_char(b, L']');
+	}
+
+	txt_char(b, L':');
+	myquote(b, kv->value);
+}
+
+static void mydump(struct stfl_widget *w, const wchar_t *prefix, int focus_id, struct txtbuf *b)
 {
-	newtxt(txt, L"{%ls%ls", w->id == focus_id ? L"!" : L"", w->type->name);
+	txt_char(b, L'{');
+	if (w->id == focus_id)
+		txt_char(b, L'!');
+	txt_str(b, w->type->name);
 
-	if (w->cls)
-		newtxt(txt, L"#%ls", w->cls);
+	if (w->cls) {
+		txt_char(b, L'#');
+		txt_str(b, w->cls);
+	}
 
 	if (w->name) {
-		newtxt(txt, L"[");
-		myquote(txt, prefix);
-		myquote(txt, w->name);
-		newtxt(txt, L"]");
+		txt_char(b, L'[');
+		myquote(b, prefix);
+		myquote(b, w->name);
+		txt_char(b, L']');
 	}
 
 	struct stfl_kv *kv = w->kv_list;
-	while (kv)
-	{
-		if (kv->name) {
-			newtxt(txt, L" %ls[", kv->key);
-			myquote(txt, prefix);
-			myquote(txt, kv->name);
-			newtxt(txt, L"]:");
-		} else
-			newtxt(txt, L" %ls:", kv->key);
-
-		myquote(txt, kv->value);
+	while (kv) {
+		mykv(kv, prefix, b);
 		kv = kv->next;
 	}
 
+	if (w->lazy_src)
+		stfl_widget_expand(w);
+
 	struct stfl_widget *c = w->first_child;
 	while (c) {
-		mydump(c, prefix, focus_id, txt);
+		mydump(c, prefix, focus_id, b);
 		c = c->next_sibling;
 	}
 
-	newtxt(txt, L"}");
+	txt_char(b, L'}');
 }
 
-static void mytext(struct stfl_widget *w, struct txtnode **txt)
+static void mytext(struct stfl_widget *w, struct txtbuf *b)
 {
 	if (!wcscmp(w->type->name, L"listitem"))
 	{
 		struct stfl_kv *kv = w->kv_list;
 		while (kv) {
-			if (!wcscmp(kv->key, L"text"))
-				newtxt(txt, L"%ls\n", kv->value);
+			if (!wcscmp(kv->key, L"text")) {
+				txt_str(b, kv->value);
+				txt_char(b, L'\n');
+			}
 			kv = kv->next;
 		}
 	}
 
+	if (w->lazy_src)
+		stfl_widget_expand(w);
+
 	struct stfl_widget *c = w->first_child;
 	while (c) {
-		mytext(c, txt);
+		mytext(c, b);
 		c = c->next_sibling;
 	}
 }
 
-static wchar_t *txt2string(struct txtnode *txt)
+/*
+ * The delta is a list of lines, widgets are addressed by their path of
+ * child indices from the root ("/" is the root, "/0/2" the third child of
+ * the first child of the root):
+ *
+ *	set <path> {<type> <changed kvs>}
+ *	add <path> <index> <dump of a new child>
+ *	tree <path> <dump of a widget which is sent as a whole>
+ *	focus <path>
+ */
+struct delta_path {
+	const struct delta_path *up;
+	int index;
+};
+
+static void delta_path(const struct delta_path *p, struct txtbuf *b)
 {
-	int string_len = 0;
-	struct txtnode *t, *prev;
+	wchar_t num[16];
 
-	for (t=txt; t; t=t->prev)
-		string_len += t->len;
+	if (!p->up) {
+		txt_char(b, L'/');
+		return;
+	}
 
-	wchar_t *string = malloc(sizeof(wchar_t)*(string_len+1));
-	int i = string_len;
+	if (p->up->up)
+		delta_path(p->up, b);
+	swprintf(num, 16, L"/%d", p->index);
+	txt_str(b, num);
+}
 
-	for (t=txt; t; t=prev)
+/* like delta_path() for a widget found outside of the tree walk */
+static void delta_widget_path(struct stfl_widget *w, struct txtbuf *b)
+{
+	struct stfl_widget *c;
+	wchar_t num[16];
+	int index = 0;
+
+	if (!w->parent) {
+		txt_char(b, L'/');
+		return;
+	}
+
+	if (w->parent->parent)
+		delta_widget_path(w->parent, b);
+	for (c = w->prev_sibling; c; c = c->prev_sibling)
+		index++;
+	swprintf(num, 16, L"/%d", index);
+	txt_str(b, num);
+}
+
+static void mydelta(struct stfl_widget *w, const struct delta_path *p, long long since, struct txtbuf *b)
+{
+	struct delta_path cp = { p, 0 };
+	struct stfl_widget *c;
+	struct stfl_kv *kv;
+	wchar_t num[16];
+	int header = 0;
+
+	if (w->subtree_changed <= since)
+		return;
+
+	for (kv = w->kv_list; kv; kv = kv->next) {
+		if (kv->changed <= since)
+			continue;
+		if (!header) {
+			txt_str(b, L"set ");
+			delta_path(p, b);
+			txt_str(b, L" {");
+			txt_str(b, w->type->name);
+			header = 1;
+		}
+		mykv(kv, L"", b);
+	}
+
+	if (header)
+		txt_str(b, L"}\n");
+
+	for (c = w->first_child; c; c = c->next_sibling, cp.index++)
 	{
-		i -= t->len;
-		wmemcpy(string+i, t->value, t->len);
+		if (c->added > since) {
+			txt_str(b, L"add ");
+			delta_path(p, b);
+			swprintf(num, 16, L" %d ", cp.index);
+			txt_str(b, num);
+			mydump(c, L"", 0, b);
+			txt_char(b, L'\n');
+		} else if (c->tree_changed > since) {
+			txt_str(b, L"tree ");
+			delta_path(&cp, b);
+			txt_char(b, L' ');
+			mydump(c, L"", 0, b);
+			txt_char(b, L'\n');
+		} else
+			mydelta(c, &cp, since, b);
+	}
+}
+
+/* a delta since checkpoint 0 contains the whole tree */
+void stfl_widget_delta_reuse(struct stfl_widget *w, long long since, int focus_id, long long focus_changed,
+		wchar_t **text, size_t *size)
+{
+	struct txtbuf b = { *text, 0, *size, 0, 0, 0 };
+	struct delta_path p = { 0, 0 };
+	struct stfl_widget *fw;
 
-		prev = t->prev;
-		free(t->value);
-		free(t);
+	if (since <= 0 || w->tree_changed > since) {
+		txt_str(&b, L"tree / ");
+		mydump(w, L"", 0, &b);
+		txt_char(&b, L'\n');
+	} else
+		mydelta(w, &p, since, &b);
+
+	if ((since <= 0 || focus_changed > since) && (fw = stfl_widget_by_id(w, focus_id)) != 0) {
+		txt_str(&b, L"focus ");
+		delta_widget_path(fw, &b);
+		txt_char(&b, L'\n');
 	}
 
-	string[string_len] = 0;
-	return string;
+	txt_reuse(&b, text, size);
 }
 
-wchar_t *stfl_quote_backend(const wchar_t *text)
+/*
+ * Quotes like myquote() without allocating. Returns the length of the
+ * quoted text. Only complete segments are written and dst is always null
+ * terminated (when cap > 0), so the result is complete when the return
+ * value is less than cap.
+ */
+size_t stfl_quote_into(wchar_t *dst, size_t cap, const wchar_t *src)
 {
-	struct txtnode *txt = 0;
-	myquote(&txt, text);
-	return txt2string(txt);
+	const wchar_t *p = wcspbrk(src, L"'\"");
+	wchar_t q = p && *p == L'"' ? L'\'' : L'"';
+	size_t len = 0, written = 0, seg;
+
+	while (*src) {
+		seg = wcscspn(src, q == L'"' ? L"\"" : L"'");
+		if (len == written && len + seg + 2 < cap) {
+			dst[len] = q;
+			wmemcpy(dst + len + 1, src, seg);
+			dst[len + seg + 1] = q;
+			written += seg + 2;
+		}
+		len += seg + 2;
+		q = q == L'"' ? L'\'' : L'"';
+		src += seg;
+	}
+
+	if (cap)
+		dst[written] = 0;
+	return len;
 }
 
 wchar_t *stfl_widget_dump(struct stfl_widget *w, const wchar_t *prefix, int focus_id)
 {
-	struct txtnode *txt = 0;
-	mydump(w, prefix, focus_id, &txt);
-	return txt2string(txt);
+	struct txtbuf b = { 0, 0, 0, 0, 0, 0 };
+	mydump(w, prefix, focus_id, &b);
+	return txt_string(&b);
+}
+
+/* like stfl_widget_dump(), but writes to the buffer *text with space for *size characters */
+void stfl_widget_dump_reuse(struct stfl_widget *w, const wchar_t *prefix, int focus_id, wchar_t **text, size_t *size)
+{
+	struct txtbuf b = { *text, 0, *size, 0, 0, 0 };
+	mydump(w, prefix, focus_id, &b);
+	txt_reuse(&b, text, size);
+}
+
+void stfl_widget_text_reuse(struct stfl_widget *w, wchar_t **text, size_t *size)
+{
+	struct txtbuf b = { *text, 0, *size, 0, 0, 0 };
+	mytext(w, &b);
+	txt_reuse(&b, text, size);
+}
+
+int stfl_widget_dump_sink(struct stfl_widget *w, const wchar_t *prefix, int focus_id,
+		int (*sink)(void *ctx, const wchar_t *text, size_t len), void *ctx)
+{
+	struct txtbuf b = { malloc(TXTBUF_CHUNK * sizeof(wchar_t)), 0, TXTBUF_CHUNK, sink, ctx, 0 };
+	mydump(w, prefix, focus_id, &b);
+	return txt_finish(&b);
 }
 
-wchar_t *stfl_widget_text(struct stfl_widget *w)
+int stfl_widget_text_sink(struct stfl_widget *w,
+		int (*sink)(void *ctx, const wchar_t *text, size_t len), void *ctx)
 {
-	struct txtnode *txt = 0;
-	mytext(w, &txt);
-	return txt2string(txt);
+	struct txtbuf b = { malloc(TXTBUF_CHUNK * sizeof(wchar_t)), 0, TXTBUF_CHUNK, sink, ctx, 0 };
+	mytext(w, &b);
+	return txt_finish(&b);
 }
 
+/* writes ch as UTF-8 to buf (which needs room for 4 bytes), returns the length */
+int stfl_utf8_put(char *buf, wchar_t wc)
+{
+	unsigned int ch = wc;
+
+	if (ch < 0x80) {
+		buf[0] = ch;
+		return 1;
+	}
+	if (ch < 0x800) {
+		buf[0] = 0xc0 | (ch >> 6);
+		buf[1] = 0x80 | (ch & 0x3f);
+		return 2;
+	}
+	if (ch < 0x10000) {
+		buf[0] = 0xe0 | (ch >> 12);
+		buf[1] = 0x80 | ((ch >> 6) & 0x3f);
+		buf[2] = 0x80 | (ch & 0x3f);
+		return 3;
+	}
+	buf[0] = 0xf0 | ((ch >> 18) & 0x07);
+	buf[1] = 0x80 | ((ch >> 12) & 0x3f);
+	buf[2] = 0x80 | ((ch >> 6) & 0x3f);
+	buf[3] = 0x80 | (ch & 0x3f);
+	return 4;
+}
+
+/* a sink writing UTF-8 to the file descriptor *ctx, no matter what the locale is */
+int stfl_fd_sink(void *ctx, const wchar_t *text, size_t len)
+{
+	int fd = *(int *)ctx;
+	char buf[TXTBUF_CHUNK * 4];
+	size_t i, n = 0;
+
+	for (i = 0; i <= len; i++)
+	{
+		if (i == len || n + 4 > sizeof(buf)) {
+			char *p = buf;
+			while (n > 0) {
+				ssize_t rc = write(fd, p, n);
+				if (rc < 0 && errno == EINTR)
+					continue;
+				if (rc <= 0)
+					return -1;
+				p += rc, n -= rc;
+			}
+			if (i == len)
+				break;
+		}
+
+		n += stfl_utf8_put(buf + n, text[i]);
+	}
+
+	return 0;
+}
@@ -21,9 +21,11 @@
  */
 
 #include "stfl.h"
+#include "stfl_probes.h"
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <wchar.h>
 #include <iconv.h>
 #include <errno.h>
@@ -31,6 +33,7 @@
 
 struct stfl_ipool_entry {
 	void *data;
+	size_t size;
 	struct stfl_ipool_entry *next;
 };
 
@@ -39,6 +42,9 @@ struct stfl_ipool {
 	iconv_t from_wc_desc;
 	char *code;
 	struct stfl_ipool_entry *list;
+	unsigned long entries, peak_entries;
+	size_t bytes, peak_bytes;
+	unsigned long towc_calls, fromwc_calls;
 	pthread_mutex_t mtx;
 };
 
@@ -54,32 +60,52 @@ struct stfl_ipool *stfl_ipool_create(const char *code)
 	pool->code = strdup(code);
 	pool->list = 0;
 
+	pool->entries = pool->peak_entries = 0;
+	pool->bytes = pool->peak_bytes = 0;
+	pool->towc_calls = pool->fromwc_calls = 0;
+
 	return pool;
 }
 
-void *stfl_ipool_add(struct stfl_ipool *pool, void *data)
+/* size is only known for the buffers allocated by the pool itself */
+static void *ipool_add_sized(struct stfl_ipool *pool, void *data, size_t size)
 {
 	struct stfl_ipool_entry *entry = malloc(sizeof(struct stfl_ipool_entry));
 
 	pthread_mutex_lock(&pool->mtx);
 
 	entry->data = data;
+	entry->size = size;
 	entry->next = pool->list;
 	pool->list = entry;
 
+	pool->entries++;
+	pool->bytes += size;
+	if (pool->entries > pool->peak_entries)
+		pool->peak_entries = pool->entries;
+	if (pool->bytes > pool->peak_bytes)
+		pool->peak_bytes = pool->bytes;
+
 	pthread_mutex_unlock(&pool->mtx);
 
 	return data;
 }
 
+void *stfl_ipool_add(struct stfl_ipool *pool, void *data)
+{
+	return ipool_add_sized(pool, data, 0);
+}
 
-const wchar_t *stfl_ipool_towc(struct stfl_ipool *pool, const char *buf)
+
+static const wchar_t *ipool_towc(struct stfl_ipool *pool, const char *buf)
 {
 	if (!pool || !buf)
 		return 0;
 
 	pthread_mutex_lock(&pool->mtx);
 
+	pool->towc_calls++;
+
 	if (!strcmp("WCHAR_T", pool->code)) {
 		pthread_mutex_unlock(&pool->mtx);
 		return (wchar_t*)buf;
@@ -134,20 +160,30 @@ retry_without_growing:;
 	}
 
 	if (outbytesleft < sizeof(wchar_t))
-		buffer = realloc(buffer, buffer_size+sizeof(wchar_t));
+		buffer = realloc(buffer, buffer_size += sizeof(wchar_t));
 	*((wchar_t*)outbuf) = 0;
 
 	pthread_mutex_unlock(&pool->mtx);
-	return stfl_ipool_add(pool, buffer);
+	return ipool_add_sized(pool, buffer, buffer_size);
 }
 
-const char *stfl_ipool_fromwc(struct stfl_ipool *pool, const wchar_t *buf)
+const wchar_t *stfl_ipool_towc(struct stfl_ipool *pool, const char *buf)
+{
+	STFL_PROBE2(ipool_towc_start, pool, buf);
+	const wchar_t *ret = ipool_towc(pool, buf);
+	STFL_PROBE3(ipool_towc_end, pool, buf, ret);
+	return ret;
+}
+
+static const char *ipool_fromwc(struct stfl_ipool *pool, const wchar_t *buf)
 {
 	if (!pool || !buf)
 		return 0;
 
 	pthread_mutex_lock(&pool->mtx);
 
+	pool->fromwc_calls++;
+
 	if (!strcmp("WCHAR_T", pool->code)) {
 		pthread_mutex_unlock(&pool->mtx);
 		return (char*)buf;
@@ -202,11 +238,19 @@ retry_without_growing:;
 	}
 
 	if (outbytesleft < 1)
-		buffer = realloc(buffer, buffer_size+1);
+		buffer = realloc(buffer, buffer_size += 1);
 	*outbuf = 0;
 
 	pthread_mutex_unlock(&pool->mtx);
-	return stfl_ipool_add(pool, buffer);
+	return ipool_add_sized(pool, buffer, buffer_size);
+}
+
+const char *stfl_ipool_fromwc(struct stfl_ipool *pool, const wchar_t *buf)
+{
+	STFL_PROBE2(ipool_fromwc_start, pool, buf);
+	const char *ret = ipool_fromwc(pool, buf);
+	STFL_PROBE3(ipool_fromwc_end, pool, buf, ret);
+	return ret;
 }
 
 void stfl_ipool_flush(struct stfl_ipool *pool)
@@ -223,9 +267,26 @@ void stfl_ipool_flush(struct stfl_ipool *pool)
 		free(l);
 	}
 
+	pool->entries = 0;
+	pool->bytes = 0;
+
 	pthread_mutex_unlock(&pool->mtx);
 }
 
+/* the text is not stored in the pool, it would change the numbers, see stfl_ipool_stats() */
+wchar_t *stfl_ipool_dump(struct stfl_ipool *pool)
+{
+	wchar_t *text = malloc(256 * sizeof(wchar_t));
+
+	pthread_mutex_lock(&pool->mtx);
+	swprintf(text, 256, L"ipool %s entries:%lu bytes:%lu peak_entries:%lu peak_bytes:%lu towc:%lu fromwc:%lu\n",
+			pool->code, pool->entries, (unsigned long)pool->bytes, pool->peak_entries,
+			(unsigned long)pool->peak_bytes, pool->towc_calls, pool->fromwc_calls);
+	pthread_mutex_unlock(&pool->mtx);
+
+	return text;
+}
+
 void stfl_ipool_destroy(struct stfl_ipool *pool)
 {
 	if (!pool)
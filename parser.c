@@ -27,229 +27,461 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <langinfo.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
-#define MYWCSCSPN_SKIP_QUOTED	0x01
-#define MYWCSCSPN_SKIP_NAMES	0x02
+/*
+ * The parser reads either a wide character string or UTF-8 bytes. All
+ * characters with a meaning in STFL are ASCII, so UTF-8 text can be scanned
+ * byte by byte and only the strings which end up in the widget tree are
+ * decoded.
+ */
+struct parser_src {
+	const wchar_t *wtext;
+	const unsigned char *utext;
+	size_t len;
+};
+
+static inline wchar_t src_at(const struct parser_src *s, size_t i)
+{
+	if (i >= s->len)
+		return 0;
+	return s->wtext ? s->wtext[i] : s->utext[i];
+}
 
-static size_t mywcscspn(const wchar_t *wcs, const wchar_t *reject, int flags)
+/* decodes the character at pos+*i and leaves *i at its last byte */
+static inline wchar_t src_decode(const struct parser_src *s, size_t pos, size_t *i, size_t tlen)
+{
+	wchar_t c = src_at(s, pos + *i);
+	int n;
+
+	if (s->wtext || c < 0x80)
+		return c;
+
+	if ((c & 0xe0) == 0xc0)
+		c &= 0x1f, n = 1;
+	else if ((c & 0xf0) == 0xe0)
+		c &= 0x0f, n = 2;
+	else if ((c & 0xf8) == 0xf0)
+		c &= 0x07, n = 3;
+	else
+		return c;
+
+	while (n-- > 0 && *i + 1 < tlen) {
+		wchar_t d = src_at(s, pos + *i + 1);
+		if ((d & 0xc0) != 0x80)
+			break;
+		c = (c << 6) | (d & 0x3f);
+		(*i)++;
+	}
+
+	return c;
+}
+
+struct tokbuf {
+	wchar_t *text;
+	int len, size;
+};
+
+static inline void tokbuf_add(struct tokbuf *b, wchar_t c)
+{
+	if (b->len+1 >= b->size) {
+		b->size = b->size ? b->size * 2 : 64;
+		b->text = realloc(b->text, b->size * sizeof(wchar_t));
+	}
+	b->text[b->len++] = c;
+}
+
+static wchar_t *tokbuf_dup(struct tokbuf *b, int from)
+{
+	wchar_t *str = malloc((b->len-from+1) * sizeof(wchar_t));
+	wmemcpy(str, b->text+from, b->len-from);
+	str[b->len-from] = 0;
+	return str;
+}
+
+/*
+ * A token is a widget type or a key with an optional class and name, e.g.
+ * "label#cls[name]" or "text[name]:value". The head (type or key) is kept
+ * as it is, the name and the value are unquoted while they are scanned.
+ */
+struct token {
+	struct tokbuf head, name, value;
+	int has_name, cls_pos;
+};
+
+enum {
+	TOKEN_NONE,
+	TOKEN_TYPE,
+	TOKEN_KV
+};
+
+static inline int is_token_end(wchar_t c)
+{
+	return c == L' ' || c == L'\t' || c == L'\r' || c == L'\n' || c == L'{' || c == L'}';
+}
+
+/* text after the name block is ignored, e.g. the "#cls" in "label[name]#cls" */
+static inline void head_add(struct token *t, const struct parser_src *s, size_t *i, wchar_t c)
+{
+	if (c == L'#' && t->cls_pos < 0)
+		t->cls_pos = t->head.len;
+	tokbuf_add(&t->head, src_decode(s, 0, i, (size_t)-1));
+}
+
+static int read_token(const struct parser_src *s, size_t *pos, struct token *t)
 {
 	enum {
 		PLAIN,
 		NAME_BLOCK,
-		SINGLE_QUOTE,
-		SINGLE_QUOTE_NAME,
-		DOUBLE_QUOTE,
-		DOUBLE_QUOTE_NAME,
+		QUOTE,
+		QUOTE_NAME,
 	} state = PLAIN;
 
-	int len = 0;
-	int i;
+	int name_blocks = 0;
+	size_t i;
+	wchar_t c, quote = 0;
 
-	while (1)
-	{
-		if (!wcs[len])
-			return len;
+	t->head.len = t->name.len = t->value.len = 0;
+	t->has_name = 0;
+	t->cls_pos = -1;
 
+	for (i = *pos; (c = src_at(s, i)) != 0; i++)
+	{
 		switch (state)
 		{
 		case PLAIN:
-			if ((flags & MYWCSCSPN_SKIP_NAMES) && (wcs[len] == L'[')) {
+			if (c == L'[') {
 				state = NAME_BLOCK;
-				break;
-			}
-			if ((flags & MYWCSCSPN_SKIP_QUOTED) && (wcs[len] == L'\'')) {
-				state = SINGLE_QUOTE;
-				break;
+				name_blocks++;
+				continue;
 			}
-			if ((flags & MYWCSCSPN_SKIP_QUOTED) && (wcs[len] == L'\"')) {
-				state = DOUBLE_QUOTE;
-				break;
+			if (c == L':' || is_token_end(c))
+				goto end_of_head;
+			if (c == L'\'' || c == L'\"') {
+				state = QUOTE;
+				quote = c;
 			}
-			for (i=0; reject[i]; i++)
-				if (wcs[len] == reject[i])
-					return len;
+			if (!name_blocks)
+				head_add(t, s, &i, c);
+			break;
+		case QUOTE:
+			if (c == quote)
+				state = PLAIN;
+			if (!name_blocks)
+				head_add(t, s, &i, c);
 			break;
 		case NAME_BLOCK:
-			if ((flags & MYWCSCSPN_SKIP_QUOTED) && (wcs[len] == L'\'')) {
-				state = SINGLE_QUOTE_NAME;
-				break;
-			}
-			if ((flags & MYWCSCSPN_SKIP_QUOTED) && (wcs[len] == L'\"')) {
-				state = DOUBLE_QUOTE_NAME;
-				break;
+			if (c == L'\'' || c == L'\"') {
+				state = QUOTE_NAME;
+				quote = c;
 			}
-			if (wcs[len] == L']')
+			else if (c == L']')
 				state = PLAIN;
+			else if (name_blocks == 1)
+				tokbuf_add(&t->name, src_decode(s, 0, &i, (size_t)-1));
 			break;
-		case SINGLE_QUOTE:
-		case SINGLE_QUOTE_NAME:
-			if (wcs[len] == L'\'')
-				state = state == SINGLE_QUOTE ? PLAIN : NAME_BLOCK;
-			break;
-		case DOUBLE_QUOTE:
-		case DOUBLE_QUOTE_NAME:
-			if (wcs[len] == L'\"')
-				state = state == DOUBLE_QUOTE ? PLAIN : NAME_BLOCK;
+		case QUOTE_NAME:
+			if (c == quote)
+				state = NAME_BLOCK;
+			else if (name_blocks == 1)
+				tokbuf_add(&t->name, src_decode(s, 0, &i, (size_t)-1));
 			break;
 		}
-
-		len++;
 	}
-}
 
-static wchar_t *unquote(const wchar_t *text, int tlen)
-{
-	int len_v = 0, i, j;
-	wchar_t *value;
+end_of_head:
+	if (i == *pos)
+		return TOKEN_NONE;
 
-	if (!text)
-		return 0;
+	t->has_name = name_blocks > 0;
+	tokbuf_add(&t->head, 0);
+	tokbuf_add(&t->name, 0);
+	t->head.len--;
+	t->name.len--;
 
-	for (i=0; (i<tlen || tlen<0) && text[i]; i++)
-	{
-		if (text[i] == L'\'')
-			while (1) {
-				if (++i == tlen && tlen >= 0)
-					goto finish_len_v_loop;
-				if (!text[i] || text[i] == L'\'') break;
-				len_v++;
-			}
-		else
-		if (text[i] == L'\"')
-			while (1) {
-				if (++i == tlen && tlen >= 0)
-					goto finish_len_v_loop;
-				if (!text[i] || text[i] == L'\"') break;
-				len_v++;
-			}
-		else
-			len_v++;
-finish_len_v_loop:;
+	if (c != L':') {
+		*pos = i;
+		return TOKEN_TYPE;
 	}
 
-	value = malloc(sizeof(wchar_t)*(len_v+1));
+	state = PLAIN;
 
-	for (i=j=0; (i<tlen || tlen<0) && text[i]; i++)
+	for (i++; (c = src_at(s, i)) != 0; i++)
 	{
-		if (text[i] == L'\'')
-			while (1) {
-				if (++i == tlen && tlen >= 0)
-					goto finish_copy_loop;
-				if (!text[i] || text[i] == L'\'') break;
-				value[j++] = text[i];
-			}
-		else
-		if (text[i] == L'\"')
-			while (1) {
-				if (++i == tlen && tlen >= 0)
-					goto finish_copy_loop;
-				if (!text[i] || text[i] == L'\"') break;
-				value[j++] = text[i];
+		if (state == PLAIN) {
+			if (c == L'\'' || c == L'\"') {
+				state = QUOTE;
+				quote = c;
+				continue;
 			}
-		else
-			value[j++] = text[i];
-finish_copy_loop:;
+			if (is_token_end(c))
+				break;
+		}
+		else if (c == quote) {
+			state = PLAIN;
+			continue;
+		}
+		tokbuf_add(&t->value, src_decode(s, 0, &i, (size_t)-1));
 	}
 
-	value[j] = 0;
-	assert(j == len_v);
+	*pos = i;
+	return TOKEN_KV;
+}
 
-	return value;
+static void token_free(struct token *t)
+{
+	free(t->head.text);
+	free(t->name.text);
+	free(t->value.text);
 }
 
-static void extract_name(wchar_t **key, wchar_t **name)
+static struct stfl_widget *token_widget(struct token *t)
 {
-	int len = wcscspn(*key, L"[");
+	wchar_t *cls = 0;
 
-	if ((*key)[len] == 0) {
-		*name = 0;
-		return;
+	if (t->cls_pos >= 0) {
+		cls = tokbuf_dup(&t->head, t->cls_pos+1);
+		t->head.text[t->cls_pos] = 0;
 	}
 
-	*name = compat_wcsdup(*key+len+1);
-	*key = realloc(*key, sizeof(wchar_t)*(len+1));
-	(*key)[len] = 0;
+	struct stfl_widget *n = stfl_widget_new(t->head.text);
 
-	len = mywcscspn(*name, L"]", MYWCSCSPN_SKIP_QUOTED);
-	(*name)[len] = 0;
+	if (!n) {
+		free(cls);
+		return 0;
+	}
+
+	n->name = t->has_name ? tokbuf_dup(&t->name, 0) : 0;
+	n->cls = cls;
+	return n;
 }
 
-static void extract_class(wchar_t **key, wchar_t **cls)
+static void token_kv(struct stfl_widget *w, struct token *t)
 {
-	int len = wcscspn(*key, L"#");
+	struct stfl_kv *kv = stfl_widget_setkv_take(w, tokbuf_dup(&t->head, 0), tokbuf_dup(&t->value, 0));
 
-	if ((*key)[len] == 0) {
-		*cls = 0;
-		return;
+	if (kv->name)
+		free(kv->name);
+	kv->name = t->has_name ? tokbuf_dup(&t->name, 0) : 0;
+}
+
+/*
+ * Widgets with a ".lazy:1" on their own line keep the source of their
+ * children as text until stfl_widget_expand() is called. The text is a
+ * complete form description with the widget type as root, so it can be
+ * parsed with the normal parser later.
+ */
+static struct stfl_kv *own_kv(struct stfl_widget *w, const wchar_t *key)
+{
+	struct stfl_kv *kv;
+
+	for (kv = w->kv_list; kv; kv = kv->next)
+		if (!wcscmp(kv->key, key))
+			return kv;
+	return 0;
+}
+
+static int is_lazy(struct stfl_widget *w)
+{
+	struct stfl_kv *kv = own_kv(w, L".lazy");
+	return kv && !wcscmp(kv->value, L"1");
+}
+
+static wchar_t *lazy_text(const struct parser_src *s, size_t from, size_t to, struct stfl_widget *w, int brackets)
+{
+	size_t type_len = wcslen(w->type->name), len = 0, i;
+	wchar_t *text = malloc((type_len + to-from + 4) * sizeof(wchar_t));
+
+	if (brackets)
+		text[len++] = L'{';
+	wmemcpy(text+len, w->type->name, type_len);
+	len += type_len;
+	text[len++] = brackets ? L' ' : L'\n';
+
+	if (s->wtext) {
+		wmemcpy(text+len, s->wtext+from, to-from);
+		len += to-from;
+	} else {
+		for (i = 0; from+i < to; i++)
+			text[len++] = src_decode(s, from, &i, to-from);
 	}
 
-	*cls = compat_wcsdup(*key+len+1);
-	*key = realloc(*key, sizeof(wchar_t)*(len+1));
-	(*key)[len] = 0;
+	if (brackets)
+		text[len++] = L'}';
+	text[len] = 0;
+
+	return text;
 }
 
-static int read_type(const wchar_t **text, wchar_t **type, wchar_t **name, wchar_t **cls)
+/* returns the position of the bracket closing the current widget or 0 */
+static size_t lazy_end_brackets(const struct parser_src *s, size_t pos)
 {
-	int len = mywcscspn(*text, L" \t\r\n:{}", MYWCSCSPN_SKIP_QUOTED|MYWCSCSPN_SKIP_NAMES);
+	int level = 0;
+	wchar_t c, quote = 0;
+
+	for (; (c = src_at(s, pos)) != 0; pos++) {
+		if (quote) {
+			if (c == quote)
+				quote = 0;
+		} else if (c == L'\'' || c == L'"')
+			quote = c;
+		else if (c == L'{')
+			level++;
+		else if (c == L'}' && level-- == 0)
+			return pos;
+	}
 
-	if ((*text)[len] == L':' || len == 0)
-		return 0;
+	return 0;
+}
 
-	*type = malloc((len+1)*sizeof(wchar_t));
-	wmemcpy(*type, *text, len);
-	(*type)[len] = 0;
-	*text += len;
+/*
+ * Returns the position of the line break before the first line which is
+ * not indented deeper than the widget (or the end of the text). Comments
+ * and empty lines are included, so are lines continuing a quoted value.
+ */
+static size_t lazy_end_indent(const struct parser_src *s, size_t pos, int indent)
+{
+	wchar_t c, quote = 0;
+
+	while (src_at(s, pos))
+	{
+		size_t line = pos;
+		int n = 0;
+
+		while ((c = src_at(s, line)) == L'\r' || c == L'\n')
+			line++;
+		while (src_at(s, line+n) == L' ')
+			n++;
+
+		c = src_at(s, line+n);
+
+		if (c != 0 && c != L'\r' && c != L'\n' && c != L'*' && n <= indent)
+			break;
+
+		pos = line+n;
+
+		if (c == L'*') {
+			while ((c = src_at(s, pos)) && c != L'\r' && c != L'\n')
+				pos++;
+			continue;
+		}
+
+		if (c == L'<') {
+			while ((c = src_at(s, pos)) && c != L'>' && c != L'\r' && c != L'\n')
+				pos++;
+		}
 
-	extract_name(type, name);
-	extract_class(type, cls);
+		for (; (c = src_at(s, pos)) && (quote || (c != L'\r' && c != L'\n')); pos++) {
+			if (quote) {
+				if (c == quote)
+					quote = 0;
+			} else if (c == L'\'' || c == L'"')
+				quote = c;
+		}
+	}
 
-	return 1;
+	/* an unterminated quote is reported by parsing the children now */
+	return quote ? 0 : pos;
 }
 
-static int read_kv(const wchar_t **text, wchar_t **key, wchar_t **name, wchar_t **value)
+/*
+ * Tells if a widget or variable name may be defined in the source of a lazy
+ * subtree, without parsing it. The name blocks are compared like
+ * read_token() unquotes them. A subtree which includes files may define any
+ * name.
+ */
+int stfl_lazy_has_name(const wchar_t *text, const wchar_t *name)
 {
-	int len_k = mywcscspn(*text, L" \t\r\n:{}", MYWCSCSPN_SKIP_QUOTED|MYWCSCSPN_SKIP_NAMES);
+	size_t name_len = wcslen(name);
+	int line_start = 1;
+	wchar_t c, quote = 0;
 
-	if ((*text)[len_k] != L':' || len_k == 0)
-		return 0;
+	for (; (c = *text) != 0; text++)
+	{
+		if (quote) {
+			if (c == quote)
+				quote = 0;
+			continue;
+		}
+
+		if (c == L'\r' || c == L'\n' || c == L'{') {
+			line_start = 1;
+			continue;
+		}
+		if (c == L' ' || c == L'\t')
+			continue;
+
+		if (line_start && c == L'<')
+			return 1;
+		if (line_start && c == L'*') {
+			while (text[1] && text[1] != L'\r' && text[1] != L'\n')
+				text++;
+			continue;
+		}
+		line_start = 0;
+
+		if (c == L'\'' || c == L'"') {
+			quote = c;
+			continue;
+		}
+		if (c != L'[')
+			continue;
 
-	*key = malloc((len_k+1)*sizeof(wchar_t));
-	wmemcpy(*key, *text, len_k);
-	(*key)[len_k] = 0;
-	*text += len_k+1;
+		size_t len = 0;
+		int match = 1;
 
-	extract_name(key, name);
+		for (text++; (c = *text) != 0 && (quote || c != L']'); text++) {
+			if (quote ? c == quote : (c == L'\'' || c == L'"')) {
+				quote = quote ? 0 : c;
+				continue;
+			}
+			if (len >= name_len || name[len++] != c)
+				match = 0;
+		}
 
-	int qval_len = mywcscspn(*text, L" \t\r\n{}", MYWCSCSPN_SKIP_QUOTED);
-	*value = unquote(*text, qval_len);
-	*text += qval_len;
+		if (match && len == name_len)
+			return 1;
+		if (!c)
+			break;
+	}
 
-	return 1;
+	return 0;
 }
 
-struct stfl_widget *stfl_parser(const wchar_t *text)
+static struct stfl_widget *parser(const struct parser_src *s)
 {
 	struct stfl_widget *root = 0;
 	struct stfl_widget *current = 0;
 	int bracket_indenting = -1;
 	int bracket_level = 0;
+	size_t pos = 0;
+	struct token tok;
+
+	memset(&tok, 0, sizeof(tok));
 
 	while (1)
 	{
+		struct stfl_widget *line_widget = 0;
 		int indenting = 0;
 
 		if (bracket_indenting >= 0)
 		{
-			while (*text == L' ' || *text == L'\t') text++;
+			while (src_at(s, pos) == L' ' || src_at(s, pos) == L'\t') pos++;
 
-			while (*text == L'}') {
-				bracket_level--; text++;
-				while (*text == L' ' || *text == L'\t') text++;
+			while (src_at(s, pos) == L'}') {
+				bracket_level--; pos++;
+				while (src_at(s, pos) == L' ' || src_at(s, pos) == L'\t') pos++;
 			}
 
-			while (*text == L'{') {
-				bracket_level++; text++;
-				while (*text == L' ' || *text == L'\t') text++;
+			while (src_at(s, pos) == L'{') {
+				bracket_level++; pos++;
+				while (src_at(s, pos) == L' ' || src_at(s, pos) == L'\t') pos++;
 			}
 
 			if (bracket_level == 0)
@@ -259,70 +491,88 @@ struct stfl_widget *stfl_parser(const wchar_t *text)
 				goto parser_error;
 		}
 		else
-			if (*text == L'}')
+			if (src_at(s, pos) == L'}')
 				goto parser_error;
 
 		if (bracket_indenting >= 0)
 		{
-			while (*text == L' ' || *text == L'\t')
-				text++;
+			while (src_at(s, pos) == L' ' || src_at(s, pos) == L'\t')
+				pos++;
 
-			if (*text == L'\r' || *text == L'\n')
+			if (src_at(s, pos) == L'\r' || src_at(s, pos) == L'\n')
 				goto parser_error;
 
 			indenting = bracket_indenting + (bracket_level-1);
 		}
 		else
 		{
-			while (*text == L' ' || *text == L'\t' || *text == L'\r' || *text == L'\n') {
-				if (*text == L'\r' || *text == L'\n')
+			wchar_t c;
+
+			while ((c = src_at(s, pos)) == L' ' || c == L'\t' || c == L'\r' || c == L'\n') {
+				if (c == L'\r' || c == L'\n')
 					indenting = 0;
 				else
-				if (*text == L'\t')
+				if (c == L'\t')
 					indenting = -1;
 				else
 				if (indenting >= 0)
 					indenting++;
-				text++;
+				pos++;
 			}
 
-			if (*text == L'*') {
-				while (*text && *text != L'\r' && *text != L'\n')
-					text++;
+			if (c == L'*') {
+				while ((c = src_at(s, pos)) && c != L'\r' && c != L'\n')
+					pos++;
 				continue;
 			}
 
-			if (*text == L'{') {
+			if (c == L'{') {
 				bracket_indenting = indenting;
 				continue;
 			}
 		}
 
-		if (*text == 0)
+		if (src_at(s, pos) == 0)
 			break;
 
-		wchar_t *key, *name, *cls, *value;
 		if (indenting < 0)
 			goto parser_error;
 
-		if (*text == L'<')
+		if (src_at(s, pos) == L'<')
 		{
-			int filename_len = wcscspn(++text, L">");
-			wchar_t wfn[filename_len+1];
+			size_t filename_len = 0;
+
+			pos++;
+			while (src_at(s, pos+filename_len) && src_at(s, pos+filename_len) != L'>')
+				filename_len++;
 
-			wmemcpy(wfn, text, filename_len+1);
-			wfn[filename_len] = 0;
+			char *filename;
 
-			size_t len = wcstombs(NULL,wfn,0)+1;
-			char filename[len];
-			size_t rc = wcstombs(filename, wfn, len);
-			assert(rc != (size_t)-1);
+			if (s->wtext) {
+				wchar_t wfn[filename_len+1];
+
+				wmemcpy(wfn, s->wtext+pos, filename_len);
+				wfn[filename_len] = 0;
+
+				size_t len = wcstombs(NULL,wfn,0)+1;
+				filename = malloc(len);
+				size_t rc = wcstombs(filename, wfn, len);
+				assert(rc != (size_t)-1);
+			} else {
+				filename = malloc(filename_len+1);
+				memcpy(filename, s->utext+pos, filename_len);
+				filename[filename_len] = 0;
+			}
 
-			text += filename_len;
-			if (*text) text++;
+			pos += filename_len;
+			if (src_at(s, pos)) pos++;
 
 			struct stfl_widget *n = stfl_parser_file(filename);
-			if (!n) return 0;
+			free(filename);
+			if (!n) {
+				token_free(&tok);
+				return 0;
+			}
 
 			if (root)
 			{
@@ -332,20 +582,14 @@ struct stfl_widget *stfl_parser(const wchar_t *text)
 						goto parser_error;
 				}
 
-				n->parent = current;
-				if (current->last_child) {
-					current->last_child->next_sibling = n;
-					current->last_child = n;
-				} else {
-					current->first_child = n;
-					current->last_child = n;
-				}
+				stfl_widget_link_child(current, n, 0);
 
 				n->parser_indent = indenting;
 				current = n;
 			}
 			else
 				root = n;
+			line_widget = n;
 		}
 		else
 		if (root)
@@ -356,82 +600,77 @@ struct stfl_widget *stfl_parser(const wchar_t *text)
 					goto parser_error;
 			}
 
-			if (read_type(&text, &key, &name, &cls) == 1)
+			int token = read_token(s, &pos, &tok);
+
+			if (token == TOKEN_TYPE)
 			{
-				struct stfl_widget *n = stfl_widget_new(key);
+				struct stfl_widget *n = token_widget(&tok);
 				if (!n)
 					goto parser_error;
-				free(key);
-
-				n->parent = current;
-				if (current->last_child) {
-					current->last_child->next_sibling = n;
-					current->last_child = n;
-				} else {
-					current->first_child = n;
-					current->last_child = n;
-				}
+
+				stfl_widget_link_child(current, n, 0);
 
 				n->parser_indent = indenting;
-				n->name = unquote(name, -1);
-				free(name);
-				n->cls = cls;
 				current = n;
+				line_widget = n;
 			}
 			else
-			if (read_kv(&text, &key, &name, &value) == 1)
-			{
-				struct stfl_kv *kv = stfl_widget_setkv_str(current, key, value);
-				if (kv->name)
-					free(kv->name);
-				kv->name = unquote(name, -1);
-				free(name);
-
-				free(key);
-				free(value);
-			}
+			if (token == TOKEN_KV)
+				token_kv(current, &tok);
 			else
 				goto parser_error;
 		}
 		else
 		{
-			if (read_type(&text, &key, &name, &cls) == 0)
+			if (read_token(s, &pos, &tok) != TOKEN_TYPE)
 				goto parser_error;
 
-			struct stfl_widget *n = stfl_widget_new(key);
+			struct stfl_widget *n = token_widget(&tok);
 			if (!n)
 				goto parser_error;
-			free(key);
 
 			root = n;
 			current = n;
-			n->name = unquote(name, -1);
-			free(name);
-			n->cls = cls;
+			line_widget = n;
 		}
 
-		while (*text && *text != L'\n' && *text != L'\r' && *text != L'{' && *text != L'}')
+		wchar_t c;
+		while ((c = src_at(s, pos)) && c != L'\n' && c != L'\r' && c != L'{' && c != L'}')
 		{
-			while (*text == L' ' || *text == L'\t')
-				text++;
+			while (src_at(s, pos) == L' ' || src_at(s, pos) == L'\t')
+				pos++;
 
-			if (*text && *text != L'\n' && *text != L'\r' && *text != L'{' && *text != L'}')
+			if ((c = src_at(s, pos)) && c != L'\n' && c != L'\r' && c != L'{' && c != L'}')
 			{
-				if (read_kv(&text, &key, &name, &value) == 0)
+				if (read_token(s, &pos, &tok) != TOKEN_KV)
 					goto parser_error;
 
-				struct stfl_kv *kv = stfl_widget_setkv_str(current, key, value);
-				if (kv->name)
-					free(kv->name);
-				kv->name = unquote(name, -1);
-				free(name);
+				token_kv(current, &tok);
+			}
+		}
 
-				free(key);
-				free(value);
+		if (line_widget && !line_widget->first_child && is_lazy(line_widget))
+		{
+			size_t end = 0;
+
+			if (bracket_indenting >= 0) {
+				if (c == L'{')
+					end = lazy_end_brackets(s, pos);
+				if (end > pos)
+					line_widget->lazy_src = lazy_text(s, pos, end, line_widget, 1);
+			} else if (c != L'{' && c != L'}') {
+				end = lazy_end_indent(s, pos, indenting);
+				if (end > pos)
+					line_widget->lazy_src = lazy_text(s, pos, end, line_widget, 0);
 			}
+
+			if (line_widget->lazy_src)
+				pos = end;
 		}
 	}
 
+	token_free(&tok);
+
 	if (root)
 		return root;
 
@@ -440,17 +679,22 @@ parser_error:;
 
 	fprintf(stderr, "STFL Parser Error near '");
 
-	for (i=0; *text && i<20; i++, text++)
-		if (*text == L'\n')
+	for (i=0; src_at(s, pos) && i<20; i++, pos++) {
+		wchar_t c = src_at(s, pos);
+		if (c == L'\n')
 			fprintf(stderr, "\\n");
 		else
-		if (*text == L'\t')
+		if (c == L'\t')
 			fprintf(stderr, " ");
 		else
-		if (*text < 32)
-			fprintf(stderr, "\\%03lo", (long unsigned int)*text);
+		if (c < 32)
+			fprintf(stderr, "\\%03lo", (long unsigned int)c);
+		else
+		if (s->utext)
+			fputc(c, stderr);
 		else
-			fprintf(stderr, "%lc", (wint_t)*text);
+			fprintf(stderr, "%lc", (wint_t)c);
+	}
 
 	fprintf(stderr, "'.\r\n");
 	abort();
@@ -458,15 +702,80 @@ parser_error:;
 	return 0;
 }
 
-struct stfl_widget *stfl_parser_file(const char *filename)
+struct stfl_widget *stfl_parser(const wchar_t *text)
 {
-	FILE *f = fopen(filename, "r");
+	struct parser_src s = { text, 0, (size_t)-1 };
 
-	if (!f) {
-		fprintf(stderr, "STFL Parser Error: Can't read file '%s'!\n", filename);
-		abort();
-		return 0;
-	}
+	STFL_PROBE1(parse_start, text);
+	struct stfl_widget *root = parser(&s);
+	STFL_PROBE2(parse_end, text, root);
+	return root;
+}
+
+struct stfl_widget *stfl_parser_utf8(const char *text, size_t len)
+{
+	struct parser_src s = { 0, (const unsigned char *)text, len };
+
+	STFL_PROBE1(parse_start, text);
+	struct stfl_widget *root = parser(&s);
+	STFL_PROBE2(parse_end, text, root);
+	return root;
+}
+
+/* values which have been set since the widget was parsed are kept */
+static void expand_kvs(struct stfl_widget *w, struct stfl_kv *kv)
+{
+	if (!kv)
+		return;
+
+	expand_kvs(w, kv->next);
+
+	if (own_kv(w, kv->key))
+		return;
+
+	struct stfl_kv *n = stfl_widget_setkv_take(w, kv->key, kv->value);
+	n->name = kv->name;
+	kv->key = kv->value = kv->name = 0;
+}
+
+/*
+ * parses the children of a lazy widget, see is_lazy(). The new widgets are
+ * sent as a whole by stfl_dump_delta() and a '!' in them takes the focus
+ * once the widget is part of a form.
+ */
+void stfl_widget_expand(struct stfl_widget *w)
+{
+	wchar_t *text = w->lazy_src;
+	struct stfl_widget *n, *c, *root;
+
+	w->lazy_src = 0;
+	n = stfl_parser(text);
+	free(text);
+
+	if (!n)
+		return;
+
+	expand_kvs(w, n->kv_list);
+
+	for (c = n->first_child; c; c = c->next_sibling)
+		c->parent = w;
+
+	w->first_child = n->first_child;
+	w->last_child = n->last_child;
+	n->first_child = n->last_child = 0;
+
+	stfl_widget_free(n);
+
+	stfl_journal_tree(w);
+
+	for (root = w; root->parent; root = root->parent) ;
+	if (root->form)
+		stfl_check_setfocus(root->form, w);
+}
+
+static struct stfl_widget *parser_file_locale(int fd)
+{
+	FILE *f = fdopen(fd, "r");
 
 	int len = 0;
 	char *text = 0;
@@ -489,13 +798,6 @@ struct stfl_widget *stfl_parser_file(const char *filename)
 	size_t rc = mbstowcs(wtext, text, wtextsize);
 	assert(rc != (size_t)-1);
 
-#if 0
-	fprintf(stderr,"strlen(text) = %u wcslen(wtext) = %u rc = %u wtextsize = %u\n", strlen(text), wcslen(wtext), rc, wtextsize);
-	fprintf(stderr,"this is where is fucked up: `%lc' `%lc' `%lc' `%lc' `%lc'\n",text1[0],text1[1],text1[2],text1[3],text1[4]);
-	fprintf(stderr,"original: `%s'\n", text);
-	fprintf(stderr,"converted: `%ls'\n", wtext);
-#endif
-
 	struct stfl_widget *w = stfl_parser(wtext);
 	free(text);
 	free(wtext);
@@ -503,3 +805,152 @@ struct stfl_widget *stfl_parser_file(const char *filename)
 	return w;
 }
 
+/*
+ * Files are mapped and parsed as UTF-8 in place when the locale uses UTF-8,
+ * other encodings are still converted to a wide character copy first.
+ * Files compiled with stfl_compile() are decoded directly from the mapping.
+ */
+static struct stfl_widget *parse_file(const char *filename, struct stat *st)
+{
+	int fd = open(filename, O_RDONLY);
+
+	if (fd < 0) {
+		fprintf(stderr, "STFL Parser Error: Can't read file '%s'!\n", filename);
+		abort();
+		return 0;
+	}
+
+	if (fstat(fd, st) < 0) {
+		st->st_ino = 0;
+		return parser_file_locale(fd);
+	}
+
+	if (st->st_size == 0) {
+		close(fd);
+		return stfl_parser_utf8("", 0);
+	}
+
+	void *text = mmap(0, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if (text == MAP_FAILED)
+		return parser_file_locale(fd);
+
+	struct stfl_widget *w;
+
+	if (stfl_binary_check(text, st->st_size)) {
+		w = stfl_binary_decode(text, st->st_size);
+		if (!w) {
+			fprintf(stderr, "STFL Parser Error: File '%s' is not a valid compiled form for this platform!\n", filename);
+			abort();
+		}
+	} else if (strcmp(nl_langinfo(CODESET), "UTF-8")) {
+		munmap(text, st->st_size);
+		return parser_file_locale(fd);
+	} else
+		w = stfl_parser_utf8(text, st->st_size);
+
+	munmap(text, st->st_size);
+	close(fd);
+
+	return w;
+}
+
+/*
+ * Included files are parsed only once. The parsed tree is kept in a cache
+ * and every include gets a copy of it, until the file is changed.
+ */
+#define INCLUDE_CACHE_MAX 64
+
+struct include_cache {
+	struct include_cache *next;
+	char *filename;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime, ctime;
+	struct stfl_widget *tree;
+};
+
+static struct include_cache *include_cache;
+static pthread_mutex_t include_cache_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static int include_cache_valid(struct include_cache *c, struct stat *st)
+{
+	return c->dev == st->st_dev && c->ino == st->st_ino && c->size == st->st_size &&
+			c->mtime == st->st_mtime && c->ctime == st->st_ctime;
+}
+
+static void include_cache_free(struct include_cache *c)
+{
+	stfl_widget_free(c->tree);
+	free(c->filename);
+	free(c);
+}
+
+struct stfl_widget *stfl_parser_file(const char *filename)
+{
+	struct include_cache *c, **cp;
+	struct stfl_widget *w = 0;
+	struct stat st;
+	int n;
+
+	if (stat(filename, &st) == 0)
+	{
+		pthread_mutex_lock(&include_cache_mtx);
+
+		for (cp = &include_cache; (c = *cp) != 0; cp = &c->next)
+			if (!strcmp(c->filename, filename))
+				break;
+
+		if (c) {
+			*cp = c->next;
+			if (include_cache_valid(c, &st)) {
+				w = stfl_widget_copy(c->tree, 0);
+				c->next = include_cache;
+				include_cache = c;
+			} else
+				include_cache_free(c);
+		}
+
+		pthread_mutex_unlock(&include_cache_mtx);
+
+		if (w)
+			return w;
+	}
+
+	w = parse_file(filename, &st);
+
+	/*
+	 * the timestamps only have a resolution of one second, a file which
+	 * was written just now may be written again without getting a new one
+	 */
+	if (!w || st.st_ino == 0 || st.st_mtime >= time(0) - 1)
+		return w;
+
+	c = calloc(1, sizeof(struct include_cache));
+	c->filename = strdup(filename);
+	c->dev = st.st_dev;
+	c->ino = st.st_ino;
+	c->size = st.st_size;
+	c->mtime = st.st_mtime;
+	c->ctime = st.st_ctime;
+	c->tree = stfl_widget_copy(w, 0);
+
+	pthread_mutex_lock(&include_cache_mtx);
+
+	c->next = include_cache;
+	include_cache = c;
+
+	for (n = 0, cp = &include_cache; *cp; n++) {
+		if (n >= INCLUDE_CACHE_MAX || (n > 0 && !strcmp((*cp)->filename, filename))) {
+			struct include_cache *old = *cp;
+			*cp = old->next;
+			include_cache_free(old);
+		} else
+			cp = &(*cp)->next;
+	}
+
+	pthread_mutex_unlock(&include_cache_mtx);
+
+	return w;
+}
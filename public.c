@@ -21,12 +21,15 @@
  */
 
 #include "stfl_internals.h"
+#include "stfl_compat.h"
 
 #include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <wchar.h>
+#include <wctype.h>
+#include <stdarg.h>
 
 int stfl_api_allow_null_pointers = 1;
 
@@ -37,32 +40,165 @@ static const wchar_t *checkret(const wchar_t *txt)
 	return txt;
 }
 
+/*
+ * Strings returned by the API functions are kept in thread-local buffers
+ * until the next call of the same function in the same thread, so no lock
+ * is needed. The pthread key is only used to free the buffers when the
+ * thread exits. The size of a buffer is counted in elements of its type.
+ */
+enum {
+	RET_QUOTE,
+	RET_COMPILE,
+	RET_DUMP,
+	RET_TEXT,
+	RET_STATS,
+	RET_MEMORY_STATS,
+	RET_IPOOL_STATS,
+	RET_DELTA,
+	RET_SNAPSHOT,
+	RET_NUM
+};
+
+struct retbuf {
+	void *data;
+	size_t size;
+};
+
+static pthread_once_t retbuf_once = PTHREAD_ONCE_INIT;
+static pthread_key_t retbuf_key;
+static __thread struct retbuf retbufs[RET_NUM];
+static __thread int retbufs_registered;
+
+static void retbuf_free(void *p)
+{
+	struct retbuf *r = p;
+	int i;
+
+	for (i = 0; i < RET_NUM; i++) {
+		free(r[i].data);
+		r[i].data = 0;
+		r[i].size = 0;
+	}
+}
+
+static void retbuf_init()
+{
+	pthread_key_create(&retbuf_key, retbuf_free);
+}
+
+static struct retbuf *retbuf_get(int idx)
+{
+	if (!retbufs_registered) {
+		pthread_once(&retbuf_once, retbuf_init);
+		pthread_setspecific(retbuf_key, retbufs);
+		retbufs_registered = 1;
+	}
+	return &retbufs[idx];
+}
+
+/* replaces the buffer with a string allocated by the caller */
+static const wchar_t *retbuf_take(int idx, wchar_t *text)
+{
+	struct retbuf *r = retbuf_get(idx);
+
+	free(r->data);
+	r->data = text;
+	r->size = text ? wcslen(text) + 1 : 0;
+	return checkret(text);
+}
+
 struct stfl_form *stfl_create(const wchar_t *text)
 {
 	struct stfl_form *f = stfl_form_new();
-	f->root = stfl_parser(text ? text : L"");
+	stfl_form_set_root(f, stfl_parser(text ? text : L""));
+	stfl_check_setfocus(f, f->root);
+	if (stfl_trace_enabled)
+		stfl_trace(STFL_TRACE_API, f, 0, 0, L"stfl_create");
+	if (stfl_record_active)
+		stfl_record_create(f, text ? text : L"");
+	return f;
+}
+
+struct stfl_form *stfl_create_utf8(const char *text, size_t len)
+{
+	struct stfl_form *f = stfl_form_new();
+	stfl_form_set_root(f, stfl_parser_utf8(text ? text : "", text ? len : 0));
 	stfl_check_setfocus(f, f->root);
+	if (stfl_trace_enabled)
+		stfl_trace(STFL_TRACE_API, f, 0, 0, L"stfl_create_utf8");
+	if (stfl_record_active)
+		stfl_record_create(f, 0);
 	return f;
 }
 
+static struct stfl_form *create_from_tree(struct stfl_widget *root, const wchar_t *api)
+{
+	if (!root)
+		return 0;
+
+	struct stfl_form *f = stfl_form_new();
+	stfl_form_set_root(f, root);
+	stfl_check_setfocus(f, f->root);
+	if (stfl_trace_enabled)
+		stfl_trace(STFL_TRACE_API, f, 0, 0, api);
+	if (stfl_record_active)
+		stfl_record_create(f, 0);
+	return f;
+}
+
+struct stfl_form *stfl_create_from_binary(const void *data, size_t size)
+{
+	return create_from_tree(data ? stfl_binary_decode(data, size) : 0, L"stfl_create_from_binary");
+}
+
+struct stfl_form *stfl_restore(const void *data, size_t size)
+{
+	struct stfl_form *f = data ? stfl_snapshot_decode(data, size) : 0;
+
+	if (f && stfl_trace_enabled)
+		stfl_trace(STFL_TRACE_API, f, 0, 0, L"stfl_restore");
+	if (f && stfl_record_active)
+		stfl_record_create(f, 0);
+	return f;
+}
+
+struct stfl_form *stfl_create_static(const struct stfl_static_widget *widgets, const struct stfl_static_kv *kvs)
+{
+	return create_from_tree(stfl_static_decode(widgets, kvs), L"stfl_create_static");
+}
+
 void stfl_free(struct stfl_form *f)
 {
+	if (stfl_trace_enabled)
+		stfl_trace(STFL_TRACE_API, f, 0, 0, L"stfl_free");
+	if (stfl_record_active)
+		stfl_record_call(f, "free", 0);
 	stfl_form_free(f);
 }
 
 void stfl_redraw()
 {
+	if (stfl_trace_enabled)
+		stfl_trace(STFL_TRACE_API, 0, 0, 0, L"stfl_redraw");
+	if (stfl_record_active)
+		stfl_record_call(0, "redraw", 0);
 	stfl_form_redraw();
 }
 
 const wchar_t *stfl_run(struct stfl_form *f, int timeout)
 {
+	if (stfl_record_active)
+		stfl_record_num(f, "run", timeout);
 	stfl_form_run(f, timeout);
 	return checkret(f->event);
 }
 
 void stfl_reset()
 {
+	if (stfl_trace_enabled)
+		stfl_trace(STFL_TRACE_API, 0, 0, 0, L"stfl_reset");
+	if (stfl_record_active)
+		stfl_record_call(0, "reset", 0);
 	stfl_form_reset();
 }
 
@@ -70,7 +206,7 @@ const wchar_t *stfl_get(struct stfl_form *f, const wchar_t *name)
 {
 	wchar_t *pseudovar_sep = name ? wcschr(name, L':') : 0;
 
-	pthread_mutex_lock(&f->mtx);
+	stfl_form_lock(f, L"stfl_get");
 
 	if (pseudovar_sep)
 	{
@@ -79,7 +215,7 @@ const wchar_t *stfl_get(struct stfl_form *f, const wchar_t *name)
 		w_name[pseudovar_sep-name] = 0;
 
 		struct stfl_widget *w = stfl_widget_by_name(f->root, w_name);
-		static wchar_t ret_buffer[16];
+		static __thread wchar_t ret_buffer[16];
 
 		if (w == 0)
 			goto this_is_not_a_pseudo_var;
@@ -124,7 +260,9 @@ this_is_not_a_pseudo_var:;
 
 void stfl_set(struct stfl_form *f, const wchar_t *name, const wchar_t *value)
 {
-	pthread_mutex_lock(&f->mtx);
+	if (stfl_record_active)
+		stfl_record_call(f, "set", 2, name, value);
+	stfl_form_lock(f, L"stfl_set");
 	stfl_setkv_by_name_str(f->root, name ? name : L"", value ? value : L"");
 	pthread_mutex_unlock(&f->mtx);
 }
@@ -133,7 +271,7 @@ const wchar_t *stfl_get_focus(struct stfl_form *f)
 {
 	struct stfl_widget *fw;
 	const wchar_t * tmpstr;
-	pthread_mutex_lock(&f->mtx);
+	stfl_form_lock(f, L"stfl_get_focus");
 	fw = stfl_widget_by_id(f->root, f->current_focus_id);
 	tmpstr = checkret(fw ? fw->name : 0);
 	pthread_mutex_unlock(&f->mtx);
@@ -143,7 +281,9 @@ const wchar_t *stfl_get_focus(struct stfl_form *f)
 void stfl_set_focus(struct stfl_form *f, const wchar_t *name)
 {
 	struct stfl_widget *fw;
-	pthread_mutex_lock(&f->mtx);
+	if (stfl_record_active)
+		stfl_record_call(f, "set_focus", 1, name);
+	stfl_form_lock(f, L"stfl_set_focus");
 	fw = stfl_widget_by_name(f->root, name ? name : L"");
 	stfl_switch_focus(0, fw, f);
 	pthread_mutex_unlock(&f->mtx);
@@ -151,215 +291,384 @@ void stfl_set_focus(struct stfl_form *f, const wchar_t *name)
 
 const wchar_t *stfl_quote(const wchar_t *text)
 {
-	static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
-	static pthread_key_t retbuffer_key;
-	static int firstrun = 1;
-	static wchar_t *retbuffer = 0;
+	struct retbuf *r = retbuf_get(RET_QUOTE);
+	size_t len;
 
-	pthread_mutex_lock(&mtx);
+	text = text ? text : L"";
+	len = stfl_quote_into(r->data, r->size, text);
 
-	if (firstrun) {
-		pthread_key_create(&retbuffer_key, free);
-		firstrun = 0;
+	if (len >= r->size) {
+		free(r->data);
+		r->size = len + 64;
+		r->data = malloc(r->size * sizeof(wchar_t));
+		stfl_quote_into(r->data, r->size, text);
 	}
 
-	retbuffer = pthread_getspecific(retbuffer_key);
-
-	if (retbuffer)
-		free(retbuffer);
+	return checkret(r->data);
+}
 
-	retbuffer = stfl_quote_backend(text ? text : L"");
+const void *stfl_compile(const wchar_t *text, size_t *size)
+{
+	struct retbuf *r = retbuf_get(RET_COMPILE);
+	struct stfl_widget *w = stfl_parser(text ? text : L"");
 
-	pthread_setspecific(retbuffer_key, retbuffer);
+	free(r->data);
+	r->data = stfl_binary_encode(w, size);
+	r->size = *size;
 
-	pthread_mutex_unlock(&mtx);
-	return checkret(retbuffer);
+	stfl_widget_free(w);
+	return r->data;
 }
 
-const wchar_t *stfl_dump(struct stfl_form *f, const wchar_t *name, const wchar_t *prefix, int focus)
+const void *stfl_snapshot(struct stfl_form *f, size_t *size)
 {
-	static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
-	static pthread_key_t retbuffer_key;
-	static int firstrun = 1;
-	static wchar_t *retbuffer = 0;
-	struct stfl_widget *w;
+	struct retbuf *r = retbuf_get(RET_SNAPSHOT);
 
-	pthread_mutex_lock(&mtx);
-	pthread_mutex_lock(&f->mtx);
+	stfl_form_lock(f, L"stfl_snapshot");
+	free(r->data);
+	r->data = stfl_snapshot_encode(f, size);
+	r->size = *size;
+	pthread_mutex_unlock(&f->mtx);
 
-	if (firstrun) {
-		pthread_key_create(&retbuffer_key, free);
-		firstrun = 0;
-	}
+	return r->data;
+}
 
-	retbuffer = pthread_getspecific(retbuffer_key);
+const wchar_t *stfl_dump(struct stfl_form *f, const wchar_t *name, const wchar_t *prefix, int focus)
+{
+	struct retbuf *r = retbuf_get(RET_DUMP);
+	struct stfl_widget *w;
+	const wchar_t *ret = 0;
 
-	if (retbuffer)
-		free(retbuffer);
+	stfl_form_lock(f, L"stfl_dump");
 
 	w = name && *name ? stfl_widget_by_name(f->root, name) : f->root;
-	retbuffer = stfl_widget_dump(w, prefix ? prefix : L"", focus ? f->current_focus_id : 0);
-
-	pthread_setspecific(retbuffer_key, retbuffer);
+	if (w) {
+		stfl_widget_dump_reuse(w, prefix ? prefix : L"", focus ? f->current_focus_id : 0,
+				(wchar_t **)&r->data, &r->size);
+		ret = r->data;
+	}
 
 	pthread_mutex_unlock(&f->mtx);
-	pthread_mutex_unlock(&mtx);
-
-	return checkret(retbuffer);
+	return checkret(ret);
 }
 
 const wchar_t *stfl_text(struct stfl_form *f, const wchar_t *name)
 {
-	static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
-	static pthread_key_t retbuffer_key;
-	static int firstrun = 1;
-	static wchar_t *retbuffer = 0;
+	struct retbuf *r = retbuf_get(RET_TEXT);
 	struct stfl_widget *w;
+	const wchar_t *ret = 0;
 
-	pthread_mutex_lock(&mtx);
-	pthread_mutex_lock(&f->mtx);
+	stfl_form_lock(f, L"stfl_text");
 
-	if (firstrun) {
-		pthread_key_create(&retbuffer_key, free);
-		firstrun = 0;
+	w = name && *name ? stfl_widget_by_name(f->root, name) : f->root;
+	if (w) {
+		stfl_widget_text_reuse(w, (wchar_t **)&r->data, &r->size);
+		ret = r->data;
 	}
 
-	retbuffer = pthread_getspecific(retbuffer_key);
+	pthread_mutex_unlock(&f->mtx);
+	return checkret(ret);
+}
 
-	if (retbuffer)
-		free(retbuffer);
+int stfl_dump_cb(struct stfl_form *f, const wchar_t *name, const wchar_t *prefix, int focus,
+		int (*cb)(void *ctx, const wchar_t *text, size_t len), void *ctx)
+{
+	struct stfl_widget *w;
+	int rc = -1;
 
-	w = name && *name ? stfl_widget_by_name(f->root, name) : f->root;
-	retbuffer = stfl_widget_text(w);
+	stfl_form_lock(f, L"stfl_dump_cb");
 
-	pthread_setspecific(retbuffer_key, retbuffer);
+	w = name && *name ? stfl_widget_by_name(f->root, name) : f->root;
+	if (w)
+		rc = stfl_widget_dump_sink(w, prefix ? prefix : L"", focus ? f->current_focus_id : 0, cb, ctx);
 
 	pthread_mutex_unlock(&f->mtx);
-	pthread_mutex_unlock(&mtx);
+	return rc;
+}
 
-	return checkret(retbuffer);
+int stfl_dump_to_fd(struct stfl_form *f, const wchar_t *name, const wchar_t *prefix, int focus, int fd)
+{
+	return stfl_dump_cb(f, name, prefix, focus, stfl_fd_sink, &fd);
 }
 
-static void stfl_modify_before(struct stfl_widget *w, struct stfl_widget *n)
+int stfl_text_cb(struct stfl_form *f, const wchar_t *name,
+		int (*cb)(void *ctx, const wchar_t *text, size_t len), void *ctx)
 {
-	if (!n || !w || !w->parent)
-		return;
+	struct stfl_widget *w;
+	int rc = -1;
+
+	stfl_form_lock(f, L"stfl_text_cb");
 
-	struct stfl_widget **prev_p = &w->parent->first_child;
-	struct stfl_widget *last_n = 0;
+	w = name && *name ? stfl_widget_by_name(f->root, name) : f->root;
+	if (w)
+		rc = stfl_widget_text_sink(w, cb, ctx);
+
+	pthread_mutex_unlock(&f->mtx);
+	return rc;
+}
 
-	while (*prev_p != w)
-		prev_p = &(*prev_p)->next_sibling;
+int stfl_text_to_fd(struct stfl_form *f, const wchar_t *name, int fd)
+{
+	return stfl_text_cb(f, name, stfl_fd_sink, &fd);
+}
 
-	*prev_p = n;
+/* links the list of new widgets starting with n into the child list of p before next */
+static void modify_link(struct stfl_widget *p, struct stfl_widget *n, struct stfl_widget *next)
+{
 	while (n) {
-		last_n = n;
-		n->parent = w->parent;
-		n = n->next_sibling;
+		struct stfl_widget *following = n->next_sibling;
+		stfl_widget_link_child(p, n, next);
+		stfl_journal_added(n);
+		n = following;
 	}
+}
 
-	last_n->next_sibling = w;
+static void stfl_modify_before(struct stfl_widget *w, struct stfl_widget *n)
+{
+	if (n && w && w->parent)
+		modify_link(w->parent, n, w);
 }
 
 static void stfl_modify_after(struct stfl_widget *w, struct stfl_widget *n)
 {
-	if (!n || !w || !w->parent)
-		return;
-
-	struct stfl_widget *first_n = n;
-	struct stfl_widget *last_n = 0;
+	if (n && w && w->parent)
+		modify_link(w->parent, n, w->next_sibling);
+}
 
-	while (n) {
-		last_n = n;
-		n->parent = w->parent;
-		n = n->next_sibling;
-	}
+static void stfl_modify_insert(struct stfl_widget *w, struct stfl_widget *n)
+{
+	if (n && w)
+		modify_link(w, n, w->first_child);
+}
 
-	if (w->next_sibling)
-		last_n->next_sibling = w->next_sibling;
-	else
-		w->parent->last_child = last_n;
+static void stfl_modify_append(struct stfl_widget *w, struct stfl_widget *n)
+{
+	if (n && w)
+		modify_link(w, n, 0);
+}
 
-	w->next_sibling = first_n;
+static int str_differs(const wchar_t *a, const wchar_t *b)
+{
+	return a && b ? wcscmp(a, b) != 0 : a != b;
 }
 
-static void stfl_modify_insert(struct stfl_widget *w, struct stfl_widget *n)
+/* takes over the kvs of the new widget, oldest first so new keys keep their order */
+static void reconcile_kvs(struct stfl_widget *w, struct stfl_kv *nkv)
 {
-	if (!n || !w)
+	struct stfl_kv *kv;
+	wchar_t *tmp;
+
+	if (!nkv)
 		return;
 
-	struct stfl_widget *first_n = n;
-	struct stfl_widget *last_n = 0;
+	reconcile_kvs(w, nkv->next);
 
-	while (n) {
-		last_n = n;
-		n->parent = w;
-		n = n->next_sibling;
-	}
+	/* an inherited @ kv of an ancestor must not be changed instead */
+	kv = stfl_widget_getkv_worker(w, nkv->key);
 
-	if (w->first_child)
-		last_n->next_sibling = w->first_child;
-	else
-		w->last_child = last_n;
+	if (!kv) {
+		kv = stfl_widget_setkv_take(w, nkv->key, nkv->value);
+		nkv->key = nkv->value = 0;
+	} else if (wcscmp(kv->value, nkv->value)) {
+		tmp = kv->value;
+		kv->value = nkv->value;
+		nkv->value = tmp;
+		stfl_journal_kv(kv);
+	}
 
-	w->first_child = first_n;
+	if (str_differs(kv->name, nkv->name)) {
+		tmp = kv->name;
+		kv->name = nkv->name;
+		nkv->name = tmp;
+		stfl_journal_kv(kv);
+	}
 }
 
-static void stfl_modify_append(struct stfl_widget *w, struct stfl_widget *n)
+/* kvs which the widgets change themselves, e.g. when a key is pressed */
+static int is_state_kv(struct stfl_widget *w, const wchar_t *key)
 {
-	if (!n || !w)
-		return;
+	static const wchar_t *keys[] = { L"pos", L"pos_name", L"offset",
+			L"cursor_x", L"cursor_y", L"scroll_x", L"scroll_y", 0 };
+	int i;
 
-	struct stfl_widget *first_n = n;
-	struct stfl_widget *last_n = 0;
+	for (i = 0; keys[i]; i++)
+		if (!wcscmp(key, keys[i]))
+			return 1;
 
-	while (n) {
-		last_n = n;
-		n->parent = w;
-		n = n->next_sibling;
-	}
+	return (!wcscmp(key, L"text") && !wcscmp(w->type->name, L"input")) ||
+			(!wcscmp(key, L"value") && !wcscmp(w->type->name, L"checkbox"));
+}
 
-	if (w->last_child)
-		w->last_child->next_sibling = first_n;
-	else
-		w->first_child = first_n;
+/* removes the kvs which are not in the new widget n, except the widget state */
+static void reconcile_drop_kvs(struct stfl_widget *w, struct stfl_widget *n)
+{
+	struct stfl_kv **kp = &w->kv_list, *kv;
+	int dropped = 0;
+
+	while ((kv = *kp) != 0) {
+		if (stfl_widget_getkv_worker(n, kv->key) || is_state_kv(w, kv->key)) {
+			kp = &kv->next;
+			continue;
+		}
+		*kp = kv->next;
+		free(kv->key);
+		free(kv->value);
+		free(kv->name);
+		free(kv);
+		dropped = 1;
+	}
 
-	w->last_child = last_n;
+	/* a "set" line of a delta can't remove kvs */
+	if (dropped)
+		stfl_journal_tree(w);
 }
 
-void stfl_modify(struct stfl_form *f, const wchar_t *name, const wchar_t *mode, const wchar_t *text)
+/*
+ * Updates the live widget w (of the same type as n) to look like the new
+ * tree n and frees n. Children are matched by name, or by position and type
+ * for children without a name. Matched widgets are kept with their ids and
+ * internal state, kvs which are not in the new tree are removed unless they
+ * hold widget state like "pos" or "offset" (see is_state_kv()).
+ */
+static void reconcile(struct stfl_form *f, struct stfl_widget *w, struct stfl_widget *n)
 {
-	struct stfl_widget *w;
-	struct stfl_widget *n;
+	struct stfl_widget *c, *nc, **old, **res;
+	int old_num = 0, res_num = 0, cursor = 0, i;
+	char *is_new;
+
+	/* an unchanged lazy subtree stays unparsed */
+	if (w->lazy_src && n->lazy_src && !wcscmp(w->lazy_src, n->lazy_src)) {
+		free(n->lazy_src);
+		n->lazy_src = 0;
+	} else {
+		if (w->lazy_src)
+			stfl_widget_expand(w);
+		if (n->lazy_src)
+			stfl_widget_expand(n);
+	}
 
-	pthread_mutex_lock(&f->mtx);
-	
-	w = stfl_widget_by_name(f->root, name ? name : L"");
+	if (str_differs(w->name, n->name)) {
+		free(w->name);
+		w->name = n->name;
+		n->name = 0;
+		stfl_journal_tree(w);
+	}
 
-	if (!w)
-		goto unlock;
+	if (str_differs(w->cls, n->cls)) {
+		free(w->cls);
+		w->cls = n->cls;
+		n->cls = 0;
+		stfl_journal_tree(w);
+	}
 
-	mode = mode ? mode : L"";
+	reconcile_drop_kvs(w, n);
+	reconcile_kvs(w, n->kv_list);
 
-	if (!wcscmp(mode, L"delete") && w != f->root) {
-		stfl_widget_free(w);
-		goto unlock;
+	for (c = w->first_child; c; c = c->next_sibling)
+		old_num++;
+	for (c = n->first_child; c; c = c->next_sibling)
+		res_num++;
+
+	if (old_num + res_num == 0) {
+		stfl_widget_free(n);
+		return;
 	}
 
-	n = stfl_parser(text ? text : L"");
+	old = malloc((old_num + res_num) * (sizeof(struct stfl_widget *) + 1));
+	res = old + old_num;
+	is_new = (char *)(res + res_num);
 
-	if (!n)
-		goto unlock;
+	for (i = 0, c = w->first_child; c; c = c->next_sibling)
+		old[i++] = c;
+
+	/* nc is always the first child of n, matched ones are freed with it */
+	for (res_num = 0; (nc = n->first_child) != 0; res_num++)
+	{
+		c = 0;
+
+		if (nc->name) {
+			for (i = 0; i < old_num; i++)
+				if (old[i] && old[i]->name && old[i]->type == nc->type &&
+						!wcscmp(old[i]->name, nc->name)) {
+					c = old[i];
+					old[i] = 0;
+					break;
+				}
+		} else {
+			for (i = cursor; i < old_num; i++)
+				if (old[i] && !old[i]->name && old[i]->type == nc->type) {
+					c = old[i];
+					old[i] = 0;
+					cursor = i+1;
+					break;
+				}
+		}
 
-	if (!wcscmp(mode, L"replace")) {
+		if (c) {
+			reconcile(f, c, nc);
+			res[res_num] = c;
+			is_new[res_num] = 0;
+		} else {
+			stfl_widget_unlink(nc);
+			res[res_num] = nc;
+			is_new[res_num] = 1;
+		}
+	}
+
+	for (i = 0; i < old_num; i++)
+		if (old[i])
+			stfl_widget_free(old[i]);
+
+	/* the kept children are still linked in their old order */
+	for (i = 0, c = w->first_child; i < res_num; i++)
+		if (!is_new[i]) {
+			if (res[i] != c)
+				stfl_journal_tree(w);
+			c = c->next_sibling;
+		}
+
+	w->first_child = w->last_child = 0;
+
+	for (i = 0; i < res_num; i++) {
+		c = res[i];
+		stfl_widget_link_child(w, c, 0);
+		if (is_new[i]) {
+			stfl_journal_added(c);
+			stfl_check_setfocus(f, c);
+		}
+	}
+
+	free(old);
+	stfl_widget_free(n);
+}
+
+/* inserts the new tree n, the caller must hold the form lock */
+static void modify_tree(struct stfl_form *f, struct stfl_widget *w, const wchar_t *mode, struct stfl_widget *n)
+{
+	if (!wcscmp(mode, L"reconcile") && w->type == n->type) {
+		reconcile(f, w, n);
+		return;
+	}
+
+	/* a replaced widget is sent as a whole in its old place by stfl_dump_delta() */
+	if (!wcscmp(mode, L"replace") || !wcscmp(mode, L"reconcile")) {
 		if (w == f->root)
-			f->root = n;
+			stfl_form_set_root(f, n);
 		else
 			stfl_modify_after(w, n);
+		stfl_widget_unlink(w);
 		stfl_widget_free(w);
+		n->added = 0;
+		stfl_journal_tree(n);
 		goto finish;
 	}
 
+	/* children are only added to parsed subtrees */
+	if (w->lazy_src)
+		stfl_widget_expand(w);
+	if (n->lazy_src && wcsstr(mode, L"_inner"))
+		stfl_widget_expand(n);
+
 	if (!wcscmp(mode, L"replace_inner")) {
 		while (w->first_child)
 			stfl_widget_free(w->first_child);
@@ -367,6 +676,7 @@ void stfl_modify(struct stfl_form *f, const wchar_t *name, const wchar_t *mode,
 		n->first_child = n->last_child = 0;
 		stfl_widget_free(n);
 		n = w;
+		stfl_journal_tree(w);
 		goto finish;
 	}
 
@@ -422,13 +732,423 @@ void stfl_modify(struct stfl_form *f, const wchar_t *name, const wchar_t *mode,
 		goto finish;
 	}
 
+	stfl_widget_free(n);
+	return;
+
 finish:
 	stfl_check_setfocus(f, n);
+}
+
+void stfl_modify(struct stfl_form *f, const wchar_t *name, const wchar_t *mode, const wchar_t *text)
+{
+	struct stfl_widget *w;
+	struct stfl_widget *n;
+
+	if (stfl_record_active)
+		stfl_record_call(f, "modify", 3, name, mode, text);
+	stfl_form_lock(f, L"stfl_modify");
+	STFL_PROBE3(modify_start, f, name, mode);
+	
+	w = stfl_widget_by_name(f->root, name ? name : L"");
+
+	if (!w)
+		goto unlock;
+
+	mode = mode ? mode : L"";
+
+	if (!wcscmp(mode, L"delete") && w != f->root) {
+		stfl_widget_free(w);
+		goto unlock;
+	}
+
+	n = stfl_parser(text ? text : L"");
+
+	if (n)
+		modify_tree(f, w, mode, n);
+
 unlock:
+	STFL_PROBE3(modify_end, f, name, mode);
 	pthread_mutex_unlock(&f->mtx);
 	return;
 }
 
+/* adds a tree which is not yet part of a form like stfl_modify() */
+static void attach_tree(struct stfl_form *f, const wchar_t *name, const wchar_t *mode,
+		struct stfl_widget *n, const wchar_t *api)
+{
+	struct stfl_widget *w;
+
+	/* recorded as a modify with a dump, so replays need no extra op */
+	if (stfl_record_active) {
+		wchar_t *text = stfl_widget_dump(n, L"", 0);
+		stfl_record_call(f, "modify", 3, name, mode, text);
+		free(text);
+	}
+
+	stfl_form_lock(f, api);
+
+	w = stfl_widget_by_name(f->root, name ? name : L"");
+
+	if (w)
+		modify_tree(f, w, mode ? mode : L"", n);
+	else
+		stfl_widget_free(n);
+
+	pthread_mutex_unlock(&f->mtx);
+}
+
+struct stfl_widget *stfl_widget_create(const wchar_t *type)
+{
+	return stfl_widget_new(type ? type : L"");
+}
+
+/* the widget functions accept the null pointer stfl_widget_create() returns for unknown types */
+
+void stfl_widget_destroy(struct stfl_widget *w)
+{
+	if (w)
+		stfl_widget_free(w);
+}
+
+void stfl_widget_set_name(struct stfl_widget *w, const wchar_t *name)
+{
+	if (!w)
+		return;
+	free(w->name);
+	w->name = name ? compat_wcsdup(name) : 0;
+}
+
+void stfl_widget_set_class(struct stfl_widget *w, const wchar_t *cls)
+{
+	if (!w)
+		return;
+	free(w->cls);
+	w->cls = cls ? compat_wcsdup(cls) : 0;
+}
+
+void stfl_widget_set_kv(struct stfl_widget *w, const wchar_t *key, const wchar_t *name, const wchar_t *value)
+{
+	if (!w || !key)
+		return;
+	struct stfl_kv *kv = stfl_widget_setkv_str(w, key, value ? value : L"");
+	free(kv->name);
+	kv->name = name ? compat_wcsdup(name) : 0;
+}
+
+int stfl_widget_append_child(struct stfl_widget *parent, struct stfl_widget *child)
+{
+	struct stfl_widget *w;
+
+	if (!parent || !child || child->parent)
+		return 0;
+
+	/* the child must not be the parent or one of its ancestors */
+	for (w = parent; w; w = w->parent)
+		if (w == child)
+			return 0;
+
+	stfl_modify_append(parent, child);
+	return 1;
+}
+
+void stfl_attach(struct stfl_form *f, const wchar_t *name, const wchar_t *mode, struct stfl_widget *w)
+{
+	if (w && !w->parent)
+		attach_tree(f, name, mode, w, L"stfl_attach");
+}
+
+struct stfl_template {
+	struct stfl_widget *tree;
+};
+
+struct stfl_template *stfl_template_create(const wchar_t *text)
+{
+	struct stfl_template *t = calloc(1, sizeof(struct stfl_template));
+	t->tree = stfl_parser(text ? text : L"");
+	return t;
+}
+
+void stfl_template_free(struct stfl_template *t)
+{
+	if (t->tree)
+		stfl_widget_free(t->tree);
+	free(t);
+}
+
+void stfl_template_instantiatev(struct stfl_form *f, const wchar_t *name, const wchar_t *mode,
+		struct stfl_template *t, const wchar_t **params)
+{
+	if (t->tree)
+		attach_tree(f, name, mode, stfl_widget_copy(t->tree, params), L"stfl_template_instantiate");
+}
+
+void stfl_template_instantiate(struct stfl_form *f, const wchar_t *name, const wchar_t *mode,
+		struct stfl_template *t, ...)
+{
+	const wchar_t *params[STFL_TEMPLATE_MAX_PARAMS*2+1];
+	va_list ap;
+	int i;
+
+	va_start(ap, t);
+	for (i = 0; i < STFL_TEMPLATE_MAX_PARAMS*2; i++)
+		if ((params[i] = va_arg(ap, const wchar_t *)) == 0)
+			break;
+	params[i] = 0;
+	va_end(ap);
+
+	stfl_template_instantiatev(f, name, mode, t, params);
+}
+
+void stfl_begin(struct stfl_form *f)
+{
+	stfl_form_lock(f, L"stfl_begin");
+	f->batch_depth++;
+}
+
+void stfl_commit(struct stfl_form *f)
+{
+	/* returns at once after stfl_begin(), the lock is recursive */
+	pthread_mutex_lock(&f->mtx);
+
+	if (f->batch_depth <= 0) {
+		fprintf(stderr, "STFL Fatal Error: Called stfl_commit() without stfl_begin().\n");
+		abort();
+	}
+
+	f->batch_depth--;
+	pthread_mutex_unlock(&f->mtx);
+	pthread_mutex_unlock(&f->mtx);
+}
+
+/* focus changes are stamped when they are seen, the caller must hold the form lock */
+static void journal_focus(struct stfl_form *f)
+{
+	if (f->journal_focus_id != f->current_focus_id) {
+		f->journal_focus_id = f->current_focus_id;
+		f->focus_changed = stfl_journal_next();
+	}
+}
+
+long long stfl_checkpoint(struct stfl_form *f)
+{
+	long long seq;
+
+	stfl_form_lock(f, L"stfl_checkpoint");
+	if (!f->journal_active) {
+		f->journal_active = 1;
+		__sync_add_and_fetch(&stfl_journal_forms, 1);
+	}
+	journal_focus(f);
+	seq = stfl_journal_next();
+	pthread_mutex_unlock(&f->mtx);
+
+	return seq;
+}
+
+const wchar_t *stfl_dump_delta(struct stfl_form *f, long long since)
+{
+	struct retbuf *r = retbuf_get(RET_DELTA);
+
+	stfl_form_lock(f, L"stfl_dump_delta");
+	journal_focus(f);
+	stfl_widget_delta_reuse(f->root, since, f->current_focus_id, f->focus_changed,
+			(wchar_t **)&r->data, &r->size);
+	pthread_mutex_unlock(&f->mtx);
+
+	return checkret(r->data);
+}
+
+/* returns the widget for a path like "/0/2" and moves *s behind it */
+static struct stfl_widget *delta_widget(struct stfl_form *f, const wchar_t **s)
+{
+	struct stfl_widget *w = f->root;
+	const wchar_t *p = *s;
+	wchar_t *end;
+	long i;
+
+	if (*p != L'/')
+		return 0;
+
+	while (*p == L'/' && iswdigit(p[1])) {
+		i = wcstol(p+1, &end, 10);
+		if (w->lazy_src)
+			stfl_widget_expand(w);
+		for (w = w->first_child; w && i > 0; i--)
+			w = w->next_sibling;
+		if (!w)
+			return 0;
+		p = end;
+	}
+
+	if (*p == L'/')
+		p++;
+
+	*s = p;
+	return w;
+}
+
+/* returns the end of the bracketed tree at s or 0 */
+static const wchar_t *delta_tree_end(const wchar_t *s)
+{
+	wchar_t q = 0;
+	int depth = 0;
+
+	if (*s != L'{')
+		return 0;
+
+	for (; *s; s++) {
+		if (q) {
+			if (*s == q)
+				q = 0;
+		} else if (*s == L'"' || *s == L'\'')
+			q = *s;
+		else if (*s == L'{')
+			depth++;
+		else if (*s == L'}' && --depth == 0)
+			return s + 1;
+	}
+
+	return 0;
+}
+
+static struct stfl_widget *delta_tree(const wchar_t **s)
+{
+	const wchar_t *end;
+	struct stfl_widget *n;
+
+	while (**s == L' ')
+		(*s)++;
+
+	if ((end = delta_tree_end(*s)) == 0)
+		return 0;
+
+	wchar_t *text = malloc((end - *s + 1) * sizeof(wchar_t));
+	wmemcpy(text, *s, end - *s);
+	text[end - *s] = 0;
+
+	n = stfl_parser(text);
+	free(text);
+	*s = end;
+	return n;
+}
+
+/* applies the output of stfl_dump_delta(), processing stops at the first bad line */
+void stfl_apply_delta(struct stfl_form *f, const wchar_t *delta)
+{
+	const wchar_t *s = delta ? delta : L"";
+	struct stfl_widget *w, *n, *c;
+	wchar_t *end;
+	long index;
+
+	if (stfl_record_active)
+		stfl_record_call(f, "apply_delta", 1, delta);
+	stfl_form_lock(f, L"stfl_apply_delta");
+
+	while (*s)
+	{
+		const wchar_t *op = s;
+
+		s += wcscspn(s, L" \n");
+		while (*s == L' ')
+			s++;
+
+		if (s - op <= 1)
+			goto next_line;
+
+		if ((w = delta_widget(f, &s)) == 0)
+			break;
+
+		if (!wcsncmp(op, L"focus ", 6)) {
+			f->current_focus_id = w->id;
+			goto next_line;
+		}
+
+		if (!wcsncmp(op, L"add ", 4)) {
+			index = wcstol(s, &end, 10);
+			if (end == s)
+				break;
+			s = end;
+			if ((n = delta_tree(&s)) == 0)
+				break;
+			if (w->lazy_src)
+				stfl_widget_expand(w);
+			for (c = w->first_child; c && index > 0; index--)
+				c = c->next_sibling;
+			if (c)
+				stfl_modify_before(c, n);
+			else
+				stfl_modify_append(w, n);
+			stfl_check_setfocus(f, n);
+			goto next_line;
+		}
+
+		if ((n = delta_tree(&s)) == 0)
+			break;
+
+		if (!wcsncmp(op, L"tree ", 5))
+			modify_tree(f, w, L"replace", n);
+		else if (!wcsncmp(op, L"set ", 4)) {
+			reconcile_kvs(w, n->kv_list);
+			stfl_widget_free(n);
+		} else
+			stfl_widget_free(n);
+
+next_line:
+		s += wcscspn(s, L"\n");
+		if (*s)
+			s++;
+	}
+
+	pthread_mutex_unlock(&f->mtx);
+}
+
+void stfl_stats_enable(struct stfl_form *f, int enable)
+{
+	stfl_form_lock(f, L"stfl_stats_enable");
+	if (enable && !f->stats)
+		f->stats = stfl_stats_new();
+	if (!enable && f->stats) {
+		stfl_stats_free(f->stats);
+		f->stats = 0;
+	}
+	pthread_mutex_unlock(&f->mtx);
+}
+
+const wchar_t *stfl_stats(struct stfl_form *f)
+{
+	const wchar_t *ret;
+
+	stfl_form_lock(f, L"stfl_stats");
+	ret = retbuf_take(RET_STATS, f->stats ? stfl_stats_dump(f->stats) : 0);
+	pthread_mutex_unlock(&f->mtx);
+
+	return ret;
+}
+
+void stfl_stats_reset(struct stfl_form *f)
+{
+	stfl_form_lock(f, L"stfl_stats_reset");
+	if (f->stats)
+		stfl_stats_clear(f->stats);
+	pthread_mutex_unlock(&f->mtx);
+}
+
+const wchar_t *stfl_memory_stats(struct stfl_form *f)
+{
+	const wchar_t *ret;
+
+	stfl_form_lock(f, L"stfl_memory_stats");
+	ret = retbuf_take(RET_MEMORY_STATS, stfl_memory_dump(f));
+	pthread_mutex_unlock(&f->mtx);
+
+	return ret;
+}
+
+const wchar_t *stfl_ipool_stats(struct stfl_ipool *pool)
+{
+	return pool ? retbuf_take(RET_IPOOL_STATS, stfl_ipool_dump(pool)) : 0;
+}
+
 const wchar_t *stfl_error()
 {
 	abort();
@@ -0,0 +1,203 @@
+/*
+ *  STFL - The Structured Terminal Forms Language/Library
+ *  Copyright (C) 2006, 2007  Clifford Wolf <clifford@clifford.at>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301 USA
+ *
+ *  record.c: Session recorder for API calls and key input
+ */
+
+#include "stfl_internals.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+int stfl_record_active = 0;
+
+static pthread_mutex_t record_mtx = PTHREAD_MUTEX_INITIALIZER;
+static FILE *record_file;
+static long long record_start;
+static int record_session, record_id_counter;
+
+int stfl_record_start(const char *filename)
+{
+	FILE *file = fopen(filename, "w");
+
+	if (!file)
+		return -1;
+
+	pthread_mutex_lock(&record_mtx);
+
+	if (record_file)
+		fclose(record_file);
+
+	record_file = file;
+	record_start = stfl_stats_now();
+	record_session++;
+	record_id_counter = 0;
+
+	fprintf(record_file, "STFL-RECORD 1\n");
+	stfl_record_active = 1;
+
+	pthread_mutex_unlock(&record_mtx);
+	return 0;
+}
+
+void stfl_record_stop()
+{
+	pthread_mutex_lock(&record_mtx);
+
+	stfl_record_active = 0;
+	if (record_file)
+		fclose(record_file);
+	record_file = 0;
+
+	pthread_mutex_unlock(&record_mtx);
+}
+
+/* strings are written as UTF-8, no matter what the current locale is */
+static void put_string(const wchar_t *s)
+{
+	if (!s) {
+		fputs(" -", record_file);
+		return;
+	}
+
+	fputs(" \"", record_file);
+
+	for (; *s; s++) {
+		unsigned int ch = *s;
+		char buf[4];
+
+		if (ch == '"' || ch == '\\')
+			fprintf(record_file, "\\%c", ch);
+		else if (ch < 0x20)
+			fprintf(record_file, "\\x%02x", ch);
+		else
+			fwrite(buf, 1, stfl_utf8_put(buf, ch), record_file);
+	}
+
+	fputc('"', record_file);
+}
+
+static void put_head(const char *op, int id)
+{
+	fprintf(record_file, "%lld %s %d", stfl_stats_now() - record_start, op, id);
+}
+
+/*
+ * Returns the id of the form in the current recording or 0. Forms which
+ * existed before the recording was started are registered with a dump of
+ * their current state, so the replay can recreate them. The caller must
+ * hold record_mtx but not the form lock.
+ */
+static int form_id(struct stfl_form *f, const wchar_t *create_text)
+{
+	if (!f)
+		return 0;
+
+	if (f->record_session == record_session)
+		return f->record_id;
+
+	f->record_session = record_session;
+	f->record_id = ++record_id_counter;
+
+	if (create_text)
+		return f->record_id;
+
+	pthread_mutex_unlock(&record_mtx);
+	pthread_mutex_lock(&f->mtx);
+	wchar_t *text = stfl_widget_dump(f->root, L"", 0);
+	pthread_mutex_unlock(&f->mtx);
+	pthread_mutex_lock(&record_mtx);
+
+	if (record_file) {
+		put_head("create", f->record_id);
+		put_string(text);
+		fputc('\n', record_file);
+	}
+
+	free(text);
+	return f->record_id;
+}
+
+/* without text the form is registered with a dump of its state */
+void stfl_record_create(struct stfl_form *f, const wchar_t *text)
+{
+	pthread_mutex_lock(&record_mtx);
+
+	if (record_file && !text)
+		form_id(f, 0);
+	else if (record_file) {
+		int id = form_id(f, text);
+		put_head("create", id);
+		put_string(text);
+		fputc('\n', record_file);
+	}
+
+	pthread_mutex_unlock(&record_mtx);
+}
+
+void stfl_record_call(struct stfl_form *f, const char *op, int nstr, ...)
+{
+	va_list ap;
+
+	pthread_mutex_lock(&record_mtx);
+
+	if (record_file) {
+		int id = form_id(f, 0);
+		put_head(op, id);
+		va_start(ap, nstr);
+		while (nstr-- > 0)
+			put_string(va_arg(ap, const wchar_t *));
+		va_end(ap);
+		fputc('\n', record_file);
+	}
+
+	pthread_mutex_unlock(&record_mtx);
+}
+
+void stfl_record_num(struct stfl_form *f, const char *op, long long arg)
+{
+	pthread_mutex_lock(&record_mtx);
+
+	if (record_file) {
+		int id = form_id(f, 0);
+		put_head(op, id);
+		fprintf(record_file, " %lld\n", arg);
+	}
+
+	pthread_mutex_unlock(&record_mtx);
+}
+
+/* called from stfl_form_run() with the form lock held */
+void stfl_record_key(struct stfl_form *f, int rc, wint_t wch)
+{
+	pthread_mutex_lock(&record_mtx);
+
+	if (record_file && f->record_session == record_session) {
+		put_head("key", f->record_id);
+		if (rc == ERR)
+			fprintf(record_file, " -1 0\n");
+		else
+			fprintf(record_file, " %lu %d\n", (unsigned long)wch, rc == KEY_CODE_YES);
+		fflush(record_file);
+	}
+
+	pthread_mutex_unlock(&record_mtx);
+}
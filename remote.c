@@ -0,0 +1,410 @@
+/*
+ *  STFL - The Structured Terminal Forms Language/Library
+ *  Copyright (C) 2006, 2007  Clifford Wolf <clifford@clifford.at>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301 USA
+ *
+ *  remote.c: Screens which send cell diffs to a remote client
+ */
+
+#include "stfl_internals.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+/*
+ * The forms are drawn on a curses screen which writes to /dev/null. After
+ * each draw the cells are compared to what the client shows and the changed
+ * runs are sent as text lines (see "Remote Screens" in the README).
+ */
+
+#define REMOTE_MAX_ATTRS 256	/* ids are reused round robin */
+#define REMOTE_RUN_GAP 4	/* unchanged cells sent to join two runs */
+#define REMOTE_LINE_MAX 64
+
+struct remote_cell {
+	wchar_t ch;
+	int attr;
+	short fg, bg;
+};
+
+struct stfl_remote {
+	int in_fd, out_fd;
+	int closed, full;
+	int rows, cols, cur_y, cur_x;
+	struct remote_cell *cells;
+	struct remote_cell attrs[REMOTE_MAX_ATTRS];
+	int nattrs, next_attr;
+	pthread_mutex_t out_mtx;
+	char *out;
+	size_t out_len, out_size;
+	char in[REMOTE_LINE_MAX];
+	size_t in_len;
+};
+
+static const struct {
+	attr_t curses;
+	int bit;
+} remote_attr_bits[] = {
+	{ A_BOLD, 1 }, { A_UNDERLINE, 2 }, { A_REVERSE, 4 }, { A_BLINK, 8 },
+	{ A_DIM, 16 }, { A_STANDOUT, 32 }, { A_PROTECT, 64 }, { A_INVIS, 128 },
+	{ A_ALTCHARSET, 256 }, { 0, 0 }
+};
+
+/* line drawing characters, so clients don't need the alternate charset */
+static const char remote_acs_chars[] = "lkmjqxtuvwn";
+static const wchar_t remote_acs_unicode[] = L"\u250c\u2510\u2514\u2518\u2500\u2502\u251c\u2524\u2534\u252c\u253c";
+
+static void out_reserve(struct stfl_remote *r, size_t len)
+{
+	if (r->out_len + len > r->out_size) {
+		while (r->out_len + len > r->out_size)
+			r->out_size = r->out_size ? r->out_size * 2 : 4096;
+		r->out = realloc(r->out, r->out_size);
+	}
+}
+
+static void out_printf(struct stfl_remote *r, const char *fmt, int a, int b, int c, int d)
+{
+	out_reserve(r, 64);
+	r->out_len += snprintf(r->out + r->out_len, 64, fmt, a, b, c, d);
+}
+
+static void out_wchar(struct stfl_remote *r, wchar_t wc)
+{
+	out_reserve(r, 4);
+	r->out_len += stfl_utf8_put(r->out + r->out_len, wc);
+}
+
+/* the attribute id for the cell, sent to the client when it is new */
+static int remote_attr_id(struct stfl_remote *r, const struct remote_cell *c)
+{
+	int i;
+
+	for (i=0; i<r->nattrs; i++)
+		if (r->attrs[i].attr == c->attr && r->attrs[i].fg == c->fg && r->attrs[i].bg == c->bg)
+			return i;
+
+	/* id 0 is always the default attribute */
+	if (r->nattrs < REMOTE_MAX_ATTRS)
+		i = r->nattrs++;
+	else {
+		i = r->next_attr;
+		r->next_attr = r->next_attr + 1 < REMOTE_MAX_ATTRS ? r->next_attr + 1 : 1;
+	}
+
+	r->attrs[i] = *c;
+	out_printf(r, "A %d %d %d %d\n", i, c->attr, c->fg, c->bg);
+	return i;
+}
+
+/* reads a cell of stdscr, the extra characters are combining characters */
+static void remote_read_cell(struct stfl_screen *s, int y, int x, struct remote_cell *c, wchar_t *wch)
+{
+	cchar_t cc;
+	attr_t attrs;
+	short pair;
+	int i;
+
+	mvwin_wch(stdscr, y, x, &cc);
+	wch[0] = 0;
+	getcchar(&cc, wch, &attrs, &pair, 0);
+
+	c->ch = wch[0] ? wch[0] : L' ';
+	c->attr = 0;
+	for (i=0; remote_attr_bits[i].bit; i++)
+		if (attrs & remote_attr_bits[i].curses)
+			c->attr |= remote_attr_bits[i].bit;
+
+	if (c->attr & 256) {
+		const char *p = c->ch < 128 ? strchr(remote_acs_chars, c->ch) : 0;
+		if (p && *p) {
+			c->ch = wch[0] = remote_acs_unicode[p - remote_acs_chars];
+			wch[1] = 0;
+			c->attr &= ~256;
+		}
+	}
+
+	if (pair > 0 && pair < s->colorpair_counter) {
+		c->fg = s->colorpair_fg[pair];
+		c->bg = s->colorpair_bg[pair];
+	} else
+		c->fg = c->bg = -1;
+}
+
+/* sends the changes of stdscr since the last frame, the screen must be locked */
+void stfl_remote_frame(struct stfl_screen *s)
+{
+	struct stfl_remote *r = s->remote;
+	int rows, cols, cur_y, cur_x, y, x, i;
+	wchar_t wch[CCHARW_MAX+1];
+
+	/* reading the cells moves the cursor */
+	getyx(stdscr, cur_y, cur_x);
+	getmaxyx(stdscr, rows, cols);
+
+	pthread_mutex_lock(&r->out_mtx);
+
+	if (rows != r->rows || cols != r->cols) {
+		r->rows = rows, r->cols = cols;
+		r->cells = realloc(r->cells, rows * cols * sizeof(struct remote_cell));
+		r->full = 1;
+	}
+
+	if (r->full) {
+		out_printf(r, "S %d %d\n", rows, cols, 0, 0);
+		for (i=0; i<rows*cols; i++) {
+			r->cells[i].ch = L' ';
+			r->cells[i].attr = 0;
+			r->cells[i].fg = r->cells[i].bg = -1;
+		}
+		r->cur_y = r->cur_x = -1;
+		r->full = 0;
+	}
+
+	struct remote_cell row[cols+1];
+
+	for (y=0; y<rows; y++)
+	{
+		struct remote_cell *shown = r->cells + y*cols;
+
+		for (x=0; x<cols; x++)
+			remote_read_cell(s, y, x, &row[x], wch);
+
+		for (x=0; x<cols; x++)
+		{
+			if (!memcmp(&row[x], &shown[x], sizeof(struct remote_cell)))
+				continue;
+
+			int start = x, end = x+1, j;
+			int id = remote_attr_id(r, &row[x]);
+
+			for (j=x+1; j<cols && j-end < REMOTE_RUN_GAP; j++) {
+				if (row[j].attr != row[x].attr || row[j].fg != row[x].fg || row[j].bg != row[x].bg)
+					break;
+				if (memcmp(&row[j], &shown[j], sizeof(struct remote_cell)))
+					end = j+1;
+			}
+
+			out_printf(r, "T %d %d %d ", y, start, id, 0);
+			for (j=start; j<end; j++) {
+				remote_read_cell(s, y, j, &row[j], wch);
+				for (i=0; wch[i] && i < CCHARW_MAX; i++)
+					out_wchar(r, wch[i]);
+				if (!wch[0])
+					out_wchar(r, L' ');
+				shown[j] = row[j];
+
+				/* the right half of a wide character isn't sent */
+				if (wcwidth(row[j].ch) == 2 && j+1 < cols) {
+					j++;
+					shown[j] = row[j];
+				}
+			}
+			out_reserve(r, 1);
+			r->out[r->out_len++] = '\n';
+			x = end-1;
+		}
+	}
+
+	wmove(stdscr, cur_y, cur_x);
+	if (cur_y != r->cur_y || cur_x != r->cur_x) {
+		out_printf(r, "C %d %d\n", cur_y, cur_x, 0, 0);
+		r->cur_y = cur_y, r->cur_x = cur_x;
+	}
+
+	out_printf(r, "F\n", 0, 0, 0, 0);
+	pthread_mutex_unlock(&r->out_mtx);
+}
+
+/* writes the pending frames, without the screen lock */
+void stfl_remote_flush(struct stfl_screen *s)
+{
+	struct stfl_remote *r = s->remote;
+	size_t n = 0;
+
+	pthread_mutex_lock(&r->out_mtx);
+	while (n < r->out_len && !r->closed) {
+		/* a client which went away must not kill the server with SIGPIPE */
+		ssize_t rc = send(r->out_fd, r->out + n, r->out_len - n, MSG_NOSIGNAL);
+		if (rc < 0 && errno == ENOTSOCK)
+			rc = write(r->out_fd, r->out + n, r->out_len - n);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc <= 0)
+			r->closed = 1;
+		else
+			n += rc;
+	}
+	r->out_len = 0;
+	pthread_mutex_unlock(&r->out_mtx);
+}
+
+void stfl_remote_redraw(struct stfl_screen *s)
+{
+	s->remote->full = 1;
+}
+
+int stfl_remote_closed(struct stfl_screen *s)
+{
+	return s->remote->closed;
+}
+
+/* handles one message from the client, returns 0 if it isn't complete yet */
+static int remote_message(struct stfl_screen *s, int *rc, wint_t *wch)
+{
+	struct stfl_remote *r = s->remote;
+	char *nl = memchr(r->in, '\n', r->in_len);
+	int a = 0, b = 0;
+
+	if (!nl) {
+		/* too long for a valid message */
+		if (r->in_len == sizeof(r->in))
+			r->in_len = 0;
+		return 0;
+	}
+
+	*nl = 0;
+	*rc = ERR;
+
+	if (r->in[0] == 'k' && sscanf(r->in+1, "%d", &a) == 1 && a >= 0) {
+		*rc = OK;
+		*wch = a;
+	}
+	else
+	if (r->in[0] == 'f' && sscanf(r->in+1, "%d", &a) == 1 && a >= 0) {
+		*rc = KEY_CODE_YES;
+		*wch = a;
+	}
+	else
+	if (r->in[0] == 'r' && sscanf(r->in+1, "%d %d", &a, &b) == 2 && a > 0 && b > 0) {
+		stfl_screen_lock(s);
+		resizeterm(a, b);
+		stfl_screen_unlock();
+		*rc = KEY_CODE_YES;
+		*wch = KEY_RESIZE;
+	}
+
+	r->in_len -= nl+1 - r->in;
+	memmove(r->in, nl+1, r->in_len);
+	return 1;
+}
+
+/* like stfl_screen_get_wch() for keys sent by the client */
+int stfl_remote_get_wch(struct stfl_screen *s, int timeout, wint_t *wch)
+{
+	struct stfl_remote *r = s->remote;
+	long long deadline = timeout >= 0 ? stfl_stats_now() + timeout * 1000000LL : 0;
+	struct pollfd pfd;
+	int rc;
+
+	pfd.fd = r->in_fd;
+	pfd.events = POLLIN;
+
+	while (1)
+	{
+		while (remote_message(s, &rc, wch))
+			if (rc != ERR)
+				return rc;
+
+		if (r->closed)
+			return ERR;
+
+		int left = -1;
+		if (timeout >= 0) {
+			long long now = stfl_stats_now();
+			left = now < deadline ? (deadline - now + 999999) / 1000000 : 0;
+		}
+
+		rc = poll(&pfd, 1, left);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc == 0)
+			return ERR;
+
+		ssize_t n = read(r->in_fd, r->in + r->in_len, sizeof(r->in) - r->in_len);
+		if (n < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (n <= 0)
+			r->closed = 1;
+		else
+			r->in_len += n;
+	}
+}
+
+/* creates the curses screen for a remote client, the screen must be locked */
+int stfl_remote_open(struct stfl_screen *s, int in_fd, int out_fd)
+{
+	struct stfl_remote *r = calloc(1, sizeof(struct stfl_remote));
+
+	r->in_fd = dup(in_fd);
+	r->out_fd = dup(out_fd);
+	r->nattrs = 1;
+	r->next_attr = 1;
+	r->attrs[0].fg = r->attrs[0].bg = -1;
+	r->full = 1;
+	pthread_mutex_init(&r->out_mtx, 0);
+
+	s->in = fopen("/dev/null", "r");
+	s->out = fopen("/dev/null", "w");
+
+	if (r->in_fd >= 0 && r->out_fd >= 0 && s->in && s->out) {
+		s->scr = newterm("xterm-256color", s->out, s->in);
+		if (!s->scr)
+			s->scr = newterm("xterm", s->out, s->in);
+	}
+
+	if (!s->scr) {
+		if (s->in)
+			fclose(s->in);
+		if (s->out)
+			fclose(s->out);
+		s->in = s->out = 0;
+		if (r->in_fd >= 0)
+			close(r->in_fd);
+		if (r->out_fd >= 0)
+			close(r->out_fd);
+		pthread_mutex_destroy(&r->out_mtx);
+		free(r);
+		return 0;
+	}
+
+	set_term(s->scr);
+	resizeterm(24, 80);
+	s->in_fd = r->in_fd;
+	s->remote = r;
+	return 1;
+}
+
+void stfl_remote_close(struct stfl_screen *s)
+{
+	struct stfl_remote *r = s->remote;
+
+	close(r->in_fd);
+	close(r->out_fd);
+	pthread_mutex_destroy(&r->out_mtx);
+	free(r->cells);
+	free(r->out);
+	free(r);
+	s->remote = 0;
+}
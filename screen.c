@@ -0,0 +1,281 @@
+/*
+ *  STFL - The Structured Terminal Forms Language/Library
+ *  Copyright (C) 2006, 2007  Clifford Wolf <clifford@clifford.at>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301 USA
+ *
+ *  screen.c: Terminals the forms are displayed on
+ */
+
+#include "stfl_internals.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+
+/*
+ * ncurses keeps the current terminal in global variables, so all curses
+ * calls are made with this lock held after switching to the screen of the
+ * form. Forms on different screens only wait for each other while they
+ * are drawn, nobody holds the lock while waiting for input.
+ */
+static pthread_mutex_t curses_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/* the terminal of the process, used by all forms without a screen */
+struct stfl_screen stfl_screen_default = { 0, 0, 0, 0, 0, 1 };
+
+struct stfl_screen *stfl_screen_current = &stfl_screen_default;
+
+static void screen_setup(struct stfl_screen *s)
+{
+	cbreak();
+	noecho();
+	nonl();
+	keypad(stdscr, TRUE);
+	doupdate();
+	start_color();
+	use_default_colors();
+	wbkgdset(stdscr, ' ');
+	s->active = 1;
+}
+
+void stfl_screen_lock(struct stfl_screen *s)
+{
+	pthread_mutex_lock(&curses_mtx);
+	if (s->scr)
+		set_term(s->scr);
+	stfl_screen_current = s;
+}
+
+void stfl_screen_unlock()
+{
+	pthread_mutex_unlock(&curses_mtx);
+}
+
+/*
+ * switch the terminal to curses mode, the screen must be locked. The
+ * terminal of the process is replaced by a remote client if STFL_REMOTE_FD
+ * is set, e.g. when the program is started by stflrc.
+ */
+void stfl_screen_start(struct stfl_screen *s)
+{
+	const char *remote_fd = getenv("STFL_REMOTE_FD");
+
+	if (s->active)
+		return;
+
+	if (!s->scr && remote_fd && *remote_fd) {
+		if (!stfl_remote_open(s, atoi(remote_fd), atoi(remote_fd))) {
+			fprintf(stderr, "STFL Fatal Error: Can't initialize the remote screen on fd %s.\n", remote_fd);
+			abort();
+		}
+	}
+
+	if (!s->scr) {
+		s->scr = newterm(0, stdout, stdin);
+		if (!s->scr) {
+			fprintf(stderr, "STFL Fatal Error: Can't initialize the terminal (check $TERM).\n");
+			abort();
+		}
+		set_term(s->scr);
+	}
+
+	screen_setup(s);
+}
+
+/* switch the terminal back to text mode, the screen must be locked */
+void stfl_screen_stop(struct stfl_screen *s)
+{
+	if (s->active) {
+		endwin();
+		s->active = 0;
+	}
+}
+
+/*
+ * Like wget_wch() on the screen with a timeout in ms (-1 waits forever).
+ * The screen must not be locked, it is only locked while curses reads.
+ */
+int stfl_screen_get_wch(struct stfl_screen *s, int timeout, wint_t *wch)
+{
+	if (s->remote)
+		return stfl_remote_get_wch(s, timeout, wch);
+
+	long long deadline = timeout >= 0 ? stfl_stats_now() + timeout * 1000000LL : 0;
+	struct pollfd pfd;
+	int rc, left;
+
+	pfd.fd = s->in_fd;
+	pfd.events = POLLIN;
+
+	while (1) {
+		left = -1;
+
+		/*
+		 * keys which curses has read ahead are not seen by poll() and a
+		 * terminal resize (SIGWINCH interrupts poll) is only reported
+		 * by wget_wch(), so ask curses first after every wakeup
+		 */
+		stfl_screen_lock(s);
+		wtimeout(stdscr, 0);
+		rc = wget_wch(stdscr, wch);
+		stfl_screen_unlock();
+
+		if (rc != ERR)
+			return rc;
+
+		if (timeout >= 0) {
+			long long now = stfl_stats_now();
+			left = now < deadline ? (deadline - now + 999999) / 1000000 : 0;
+		}
+
+		rc = poll(&pfd, 1, left);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc == 0)
+			return ERR;
+		break;
+	}
+
+	/* the rest of an escape sequence may still be on its way */
+	stfl_screen_lock(s);
+	wtimeout(stdscr, left);
+	rc = wget_wch(stdscr, wch);
+	stfl_screen_unlock();
+
+	return rc;
+}
+
+/* update the terminal from stdscr, the screen must be locked */
+void stfl_screen_refresh(struct stfl_screen *s)
+{
+	if (s->remote)
+		stfl_remote_frame(s);
+	else
+		refresh();
+}
+
+/* send the output of remote screens, without the screen lock */
+void stfl_screen_flush(struct stfl_screen *s)
+{
+	if (s->remote)
+		stfl_remote_flush(s);
+}
+
+struct stfl_screen *stfl_screen_create(int in_fd, int out_fd, const char *term)
+{
+	struct stfl_screen *s = calloc(1, sizeof(struct stfl_screen));
+	int in = dup(in_fd), out = dup(out_fd);
+
+	s->in = in >= 0 ? fdopen(in, "r") : 0;
+	s->out = out >= 0 ? fdopen(out, "w") : 0;
+	s->in_fd = in;
+	s->colorpair_counter = 1;
+
+	if (!s->in || !s->out)
+		goto error;
+
+	stfl_screen_lock(s);
+	s->scr = newterm(term, s->out, s->in);
+	if (s->scr) {
+		set_term(s->scr);
+		screen_setup(s);
+	}
+	stfl_screen_current = &stfl_screen_default;
+	stfl_screen_unlock();
+
+	if (s->scr)
+		return s;
+
+error:
+	if (s->in)
+		fclose(s->in);
+	else if (in >= 0)
+		close(in);
+	if (s->out)
+		fclose(s->out);
+	else if (out >= 0)
+		close(out);
+	free(s);
+	return 0;
+}
+
+struct stfl_screen *stfl_screen_create_remote(int in_fd, int out_fd)
+{
+	struct stfl_screen *s = calloc(1, sizeof(struct stfl_screen));
+
+	s->colorpair_counter = 1;
+
+	stfl_screen_lock(s);
+	if (stfl_remote_open(s, in_fd, out_fd))
+		screen_setup(s);
+	stfl_screen_current = &stfl_screen_default;
+	stfl_screen_unlock();
+
+	if (s->scr)
+		return s;
+
+	free(s);
+	return 0;
+}
+
+int stfl_screen_closed(struct stfl_screen *s)
+{
+	if (!s)
+		s = &stfl_screen_default;
+
+	return s->remote ? stfl_remote_closed(s) : 0;
+}
+
+void stfl_screen_free(struct stfl_screen *s)
+{
+	if (!s || s == &stfl_screen_default)
+		return;
+
+	stfl_screen_lock(s);
+	stfl_screen_stop(s);
+	delscreen(s->scr);
+	stfl_screen_current = &stfl_screen_default;
+	stfl_screen_unlock();
+
+	fclose(s->in);
+	fclose(s->out);
+	if (s->remote)
+		stfl_remote_close(s);
+	free(s);
+}
+
+void stfl_screen_attach(struct stfl_form *f, struct stfl_screen *s)
+{
+	stfl_form_lock(f, L"stfl_screen_attach");
+	f->screen = s ? s : &stfl_screen_default;
+	pthread_mutex_unlock(&f->mtx);
+}
+
+void stfl_screen_redraw(struct stfl_screen *s)
+{
+	if (!s)
+		s = &stfl_screen_default;
+
+	stfl_screen_lock(s);
+	if (s->remote)
+		stfl_remote_redraw(s);
+	else if (s->active)
+		clearok(curscr, 1);
+	stfl_screen_unlock();
+}
@@ -0,0 +1,458 @@
+/*
+ *  STFL - The Structured Terminal Forms Language/Library
+ *  Copyright (C) 2006, 2007  Clifford Wolf <clifford@clifford.at>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301 USA
+ *
+ *  stats.c: Optional per-form timing counters and memory statistics
+ */
+
+#include "stfl_internals.h"
+#include "stfl_compat.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STATS_MAX_TYPES 32
+#define STATS_HASH_SIZE 256
+
+/* log-linear histogram: 8 linear sub-buckets for every power of two */
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 * HIST_SUB)
+
+struct stats_counter {
+	unsigned long calls;
+	long long total_ns, self_ns;
+};
+
+struct stats_entry {
+	struct stats_counter prepare, draw, process;
+};
+
+struct stats_histogram {
+	unsigned long count;
+	long long max;
+	unsigned long buckets[HIST_BUCKETS];
+};
+
+struct stats_named {
+	struct stats_named *next;
+	wchar_t *name;
+	struct stats_entry e;
+};
+
+struct stfl_stats {
+	struct stats_entry types[STATS_MAX_TYPES];
+	struct stats_named *named[STATS_HASH_SIZE];
+	long long nested_ns;
+	unsigned long getkv_hit, getkv_inherited, getkv_miss;
+	struct stats_counter run, refresh, input;
+	struct stats_histogram key_to_paint, lock_hold;
+	long long key_ns;
+};
+
+__thread struct stfl_stats *stfl_stats_current;
+
+long long stfl_stats_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+struct stfl_stats *stfl_stats_new()
+{
+	return calloc(1, sizeof(struct stfl_stats));
+}
+
+void stfl_stats_clear(struct stfl_stats *s)
+{
+	int i;
+
+	for (i=0; i<STATS_HASH_SIZE; i++)
+		while (s->named[i]) {
+			struct stats_named *n = s->named[i];
+			s->named[i] = n->next;
+			free(n->name);
+			free(n);
+		}
+
+	memset(s, 0, sizeof(struct stfl_stats));
+}
+
+void stfl_stats_free(struct stfl_stats *s)
+{
+	stfl_stats_clear(s);
+	free(s);
+}
+
+static struct stats_entry *type_entry(struct stfl_stats *s, struct stfl_widget_type *t)
+{
+	int i;
+
+	for (i=0; stfl_widget_types[i] && i < STATS_MAX_TYPES; i++)
+		if (stfl_widget_types[i] == t)
+			return &s->types[i];
+
+	return 0;
+}
+
+static struct stats_entry *named_entry(struct stfl_stats *s, const wchar_t *name)
+{
+	unsigned int h = 2166136261u;
+	const wchar_t *p;
+
+	for (p=name; *p; p++)
+		h = (h ^ *p) * 16777619u;
+	h %= STATS_HASH_SIZE;
+
+	struct stats_named *n = s->named[h];
+	while (n) {
+		if (!wcscmp(n->name, name))
+			return &n->e;
+		n = n->next;
+	}
+
+	n = calloc(1, sizeof(struct stats_named));
+	n->name = compat_wcsdup(name);
+	n->next = s->named[h];
+	s->named[h] = n;
+	return &n->e;
+}
+
+static void count(struct stats_counter *c, long long total, long long self)
+{
+	c->calls++;
+	c->total_ns += total;
+	c->self_ns += self;
+}
+
+/*
+ * Child widgets are timed from within their parent. The time spent in the
+ * children is collected in nested_ns so the parent can also report the time
+ * spent in its own code only.
+ */
+#define STATS_TIMED_CALL(_s, _w, _field, _call) do {				\
+	long long saved_nested = (_s)->nested_ns;				\
+	long long start, total;							\
+	(_s)->nested_ns = 0;							\
+	start = stfl_stats_now();						\
+	_call;									\
+	total = stfl_stats_now() - start;					\
+	struct stats_entry *e = type_entry(_s, (_w)->type);			\
+	if (e)									\
+		count(&e->_field, total, total - (_s)->nested_ns);		\
+	if ((_w)->name)								\
+		count(&named_entry(_s, (_w)->name)->_field, total,		\
+				total - (_s)->nested_ns);			\
+	(_s)->nested_ns = saved_nested + total;					\
+} while (0)
+
+void stfl_stats_prepare(struct stfl_widget *w, struct stfl_form *f)
+{
+	STATS_TIMED_CALL(f->stats, w, prepare, w->type->f_prepare(w, f));
+}
+
+void stfl_stats_draw(struct stfl_widget *w, struct stfl_form *f, WINDOW *win)
+{
+	STATS_TIMED_CALL(f->stats, w, draw, w->type->f_draw(w, f, win));
+}
+
+int stfl_stats_process(struct stfl_widget *w, struct stfl_widget *fw, struct stfl_form *f, wchar_t ch, int isfunckey)
+{
+	int rc = 0;
+	STATS_TIMED_CALL(f->stats, w, process, rc = w->type->f_process(w, fw, f, ch, isfunckey));
+	return rc;
+}
+
+void stfl_stats_getkv(int result)
+{
+	if (result > 0)
+		stfl_stats_current->getkv_hit++;
+	else if (result < 0)
+		stfl_stats_current->getkv_inherited++;
+	else
+		stfl_stats_current->getkv_miss++;
+}
+
+void stfl_stats_form(struct stfl_stats *s, enum stfl_stats_phase phase, long long start)
+{
+	long long total = stfl_stats_now() - start;
+
+	switch (phase) {
+	case STFL_STATS_RUN:
+		count(&s->run, total, total);
+		break;
+	case STFL_STATS_REFRESH:
+		count(&s->refresh, total, total);
+		break;
+	case STFL_STATS_INPUT:
+		count(&s->input, total, total);
+		break;
+	}
+}
+
+static int hist_bucket(long long v)
+{
+	int e = HIST_SUB_BITS;
+
+	if (v < HIST_SUB)
+		return v < 0 ? 0 : v;
+
+	while (v >> (e+1))
+		e++;
+
+	return (e - HIST_SUB_BITS + 1) * HIST_SUB + ((v >> (e - HIST_SUB_BITS)) & (HIST_SUB-1));
+}
+
+/* largest value which still falls into bucket i */
+static long long hist_bucket_max(int i)
+{
+	if (i < HIST_SUB)
+		return i;
+
+	int e = i / HIST_SUB + HIST_SUB_BITS - 1;
+	long long base = (long long)(HIST_SUB + i % HIST_SUB) << (e - HIST_SUB_BITS);
+	return base + (1LL << (e - HIST_SUB_BITS)) - 1;
+}
+
+static void hist_add(struct stats_histogram *h, long long v)
+{
+	h->count++;
+	h->buckets[hist_bucket(v)]++;
+	if (v > h->max)
+		h->max = v;
+}
+
+static long long hist_percentile(struct stats_histogram *h, int percent)
+{
+	unsigned long rank = (h->count * percent + 99) / 100, n = 0;
+	int i;
+
+	for (i=0; i<HIST_BUCKETS; i++) {
+		n += h->buckets[i];
+		if (n >= rank) {
+			long long v = hist_bucket_max(i);
+			return v < h->max ? v : h->max;
+		}
+	}
+
+	return h->max;
+}
+
+/*
+ * A key counts as painted at the end of the next refresh(), which usually
+ * happens in the following stfl_run() call after the application has
+ * handled the event.
+ */
+/* time is when the key was read, before the locks were taken again */
+void stfl_stats_key(struct stfl_stats *s, long long time)
+{
+	if (!s->key_ns)
+		s->key_ns = time;
+}
+
+void stfl_stats_painted(struct stfl_stats *s)
+{
+	if (s->key_ns) {
+		hist_add(&s->key_to_paint, stfl_stats_now() - s->key_ns);
+		s->key_ns = 0;
+	}
+}
+
+void stfl_stats_hold(struct stfl_stats *s, long long start)
+{
+	hist_add(&s->lock_hold, stfl_stats_now() - start);
+}
+
+struct statsbuf {
+	wchar_t *text;
+	int len, size;
+};
+
+static void statsbuf_printf(struct statsbuf *b, const wchar_t *fmt, ...)
+{
+	while (1) {
+		if (b->size - b->len > 0) {
+			va_list ap;
+			va_start(ap, fmt);
+			int rc = vswprintf(b->text + b->len, b->size - b->len, fmt, ap);
+			va_end(ap);
+			if (rc >= 0) {
+				b->len += rc;
+				return;
+			}
+		}
+		b->size = b->size ? b->size * 2 : 4096;
+		b->text = realloc(b->text, b->size * sizeof(wchar_t));
+	}
+}
+
+static void print_counter(struct statsbuf *b, const wchar_t *what, const wchar_t *name,
+		const wchar_t *op, struct stats_counter *c)
+{
+	if (!c->calls)
+		return;
+
+	statsbuf_printf(b, L"%ls %ls %ls calls:%lu total_ns:%lld self_ns:%lld\n",
+			what, name, op, c->calls, c->total_ns, c->self_ns);
+}
+
+static void print_histogram(struct statsbuf *b, const wchar_t *name, struct stats_histogram *h)
+{
+	if (!h->count)
+		return;
+
+	statsbuf_printf(b, L"latency %ls - count:%lu p50_ns:%lld p90_ns:%lld p99_ns:%lld max_ns:%lld\n",
+			name, h->count, hist_percentile(h, 50), hist_percentile(h, 90),
+			hist_percentile(h, 99), h->max);
+}
+
+static void print_entry(struct statsbuf *b, const wchar_t *what, const wchar_t *name, struct stats_entry *e)
+{
+	print_counter(b, what, name, L"prepare", &e->prepare);
+	print_counter(b, what, name, L"draw", &e->draw);
+	print_counter(b, what, name, L"process", &e->process);
+}
+
+wchar_t *stfl_stats_dump(struct stfl_stats *s)
+{
+	struct statsbuf b = { 0, 0, 0 };
+	struct stats_named *n;
+	int i;
+
+	statsbuf_printf(&b, L"");
+
+	print_counter(&b, L"form", L"-", L"run", &s->run);
+	print_counter(&b, L"form", L"-", L"refresh", &s->refresh);
+	print_counter(&b, L"form", L"-", L"input", &s->input);
+
+	print_histogram(&b, L"key_to_paint", &s->key_to_paint);
+	print_histogram(&b, L"lock_hold", &s->lock_hold);
+
+	for (i=0; stfl_widget_types[i] && i < STATS_MAX_TYPES; i++)
+		print_entry(&b, L"type", stfl_widget_types[i]->name, &s->types[i]);
+
+	for (i=0; i<STATS_HASH_SIZE; i++)
+		for (n = s->named[i]; n; n = n->next)
+			print_entry(&b, L"widget", n->name, &n->e);
+
+	statsbuf_printf(&b, L"getkv - lookup hit:%lu inherited:%lu miss:%lu\n",
+			s->getkv_hit, s->getkv_inherited, s->getkv_miss);
+
+	return b.text;
+}
+
+struct memory_usage {
+	unsigned long widgets, kvs;
+	size_t widget_bytes, kv_bytes, key_bytes, value_bytes, name_bytes, internal_bytes, lazy_bytes;
+};
+
+static size_t wcs_bytes(const wchar_t *s)
+{
+	return s ? (wcslen(s) + 1) * sizeof(wchar_t) : 0;
+}
+
+static size_t memory_total(struct memory_usage *u)
+{
+	return u->widget_bytes + u->kv_bytes + u->key_bytes + u->value_bytes +
+			u->name_bytes + u->internal_bytes + u->lazy_bytes;
+}
+
+static void memory_add(struct memory_usage *u, struct memory_usage *v)
+{
+	u->widgets += v->widgets;
+	u->kvs += v->kvs;
+	u->widget_bytes += v->widget_bytes;
+	u->kv_bytes += v->kv_bytes;
+	u->key_bytes += v->key_bytes;
+	u->value_bytes += v->value_bytes;
+	u->name_bytes += v->name_bytes;
+	u->internal_bytes += v->internal_bytes;
+	u->lazy_bytes += v->lazy_bytes;
+}
+
+static void memory_walk(struct stfl_widget *w, struct memory_usage *types)
+{
+	struct memory_usage u;
+	struct stfl_kv *kv;
+	int i;
+
+	memset(&u, 0, sizeof(u));
+
+	u.widgets = 1;
+	u.widget_bytes = sizeof(struct stfl_widget);
+	u.name_bytes = wcs_bytes(w->name) + wcs_bytes(w->cls);
+	u.lazy_bytes = wcs_bytes(w->lazy_src);
+
+	if (w->type->f_memsize)
+		u.internal_bytes = w->type->f_memsize(w);
+
+	for (kv = w->kv_list; kv; kv = kv->next) {
+		u.kvs++;
+		u.kv_bytes += sizeof(struct stfl_kv);
+		u.key_bytes += wcs_bytes(kv->key);
+		u.value_bytes += wcs_bytes(kv->value);
+		u.name_bytes += wcs_bytes(kv->name);
+	}
+
+	for (i=0; stfl_widget_types[i] && i < STATS_MAX_TYPES; i++)
+		if (stfl_widget_types[i] == w->type) {
+			memory_add(&types[i], &u);
+			break;
+		}
+
+	for (w = w->first_child; w; w = w->next_sibling)
+		memory_walk(w, types);
+}
+
+/* counts the payload of the allocations, not the malloc() overhead */
+wchar_t *stfl_memory_dump(struct stfl_form *f)
+{
+	struct memory_usage types[STATS_MAX_TYPES], all;
+	struct statsbuf b = { 0, 0, 0 };
+	int i;
+
+	memset(types, 0, sizeof(types));
+	memset(&all, 0, sizeof(all));
+
+	if (f->root)
+		memory_walk(f->root, types);
+
+	for (i=0; i<STATS_MAX_TYPES; i++)
+		memory_add(&all, &types[i]);
+
+	statsbuf_printf(&b, L"form - widgets:%lu kvs:%lu widget_bytes:%lu kv_bytes:%lu key_bytes:%lu "
+			L"value_bytes:%lu name_bytes:%lu internal_bytes:%lu lazy_bytes:%lu total_bytes:%lu\n",
+			all.widgets, all.kvs, (unsigned long)all.widget_bytes, (unsigned long)all.kv_bytes,
+			(unsigned long)all.key_bytes, (unsigned long)all.value_bytes,
+			(unsigned long)all.name_bytes, (unsigned long)all.internal_bytes,
+			(unsigned long)all.lazy_bytes, (unsigned long)memory_total(&all));
+
+	for (i=0; stfl_widget_types[i] && i < STATS_MAX_TYPES; i++) {
+		if (!types[i].widgets)
+			continue;
+		statsbuf_printf(&b, L"type %ls widgets:%lu kvs:%lu internal_bytes:%lu total_bytes:%lu\n",
+				stfl_widget_types[i]->name, types[i].widgets, types[i].kvs,
+				(unsigned long)types[i].internal_bytes, (unsigned long)memory_total(&types[i]));
+	}
+
+	return b.text;
+}
@@ -33,14 +33,61 @@ extern int stfl_api_allow_null_pointers;
 
 struct stfl_form;
 struct stfl_ipool;
+struct stfl_screen;
+struct stfl_template;
+struct stfl_widget;
+
+#define STFL_TEMPLATE_MAX_PARAMS 64
+
+enum stfl_trace_type {
+	STFL_TRACE_RUN = 1,	/* arg1 = timeout */
+	STFL_TRACE_RUN_END,	/* arg1 = ns spent in stfl_run() */
+	STFL_TRACE_KEY,		/* arg1 = key code, arg2 = 1 for function keys */
+	STFL_TRACE_EVENT,	/* text = event */
+	STFL_TRACE_HANDLER,	/* text = matching on_* variable */
+	STFL_TRACE_PREPARE,	/* arg1 = ns */
+	STFL_TRACE_DRAW,	/* arg1 = ns */
+	STFL_TRACE_REFRESH,	/* arg1 = ns, arg2 = number of changed lines */
+	STFL_TRACE_LOCK,	/* arg1 = ns waited for the form lock, text = API */
+	STFL_TRACE_API		/* text = API function without a form lock */
+};
+
+struct stfl_trace_record {
+	unsigned long long time_ns;
+	unsigned long long form;
+	long long arg1, arg2;
+	unsigned int seq;
+	unsigned short type;
+	char text[26];
+};
+
+/* tables written by "stflc -c", see stfl_create_static() */
+struct stfl_static_kv {
+	const wchar_t *key, *value, *name;
+};
+
+struct stfl_static_widget {
+	const wchar_t *type, *name, *cls;
+	int setfocus, nkvs, nchildren;
+};
 
 extern struct stfl_form *stfl_create(const wchar_t *text);
+extern struct stfl_form *stfl_create_utf8(const char *text, size_t len);
+extern struct stfl_form *stfl_create_from_binary(const void *data, size_t size);
+extern struct stfl_form *stfl_create_static(const struct stfl_static_widget *widgets, const struct stfl_static_kv *kvs);
 extern void stfl_free(struct stfl_form *f);
 
 extern const wchar_t *stfl_run(struct stfl_form *f, int timeout);
 extern void stfl_redraw();
 extern void stfl_reset();
 
+extern struct stfl_screen *stfl_screen_create(int in_fd, int out_fd, const char *term);
+extern struct stfl_screen *stfl_screen_create_remote(int in_fd, int out_fd);
+extern int stfl_screen_closed(struct stfl_screen *s);
+extern void stfl_screen_free(struct stfl_screen *s);
+extern void stfl_screen_attach(struct stfl_form *f, struct stfl_screen *s);
+extern void stfl_screen_redraw(struct stfl_screen *s);
+
 extern const wchar_t * stfl_get(struct stfl_form *f, const wchar_t *name);
 extern void stfl_set(struct stfl_form *f, const wchar_t *name, const wchar_t *value);
 
@@ -48,11 +95,56 @@ extern const wchar_t *stfl_get_focus(struct stfl_form *f);
 extern void stfl_set_focus(struct stfl_form *f, const wchar_t *name);
 
 extern const wchar_t *stfl_quote(const wchar_t *text);
+extern size_t stfl_quote_into(wchar_t *dst, size_t cap, const wchar_t *src);
+extern const void *stfl_compile(const wchar_t *text, size_t *size);
 extern const wchar_t *stfl_dump(struct stfl_form *f, const wchar_t *name, const wchar_t *prefix, int focus);
 extern const wchar_t *stfl_text(struct stfl_form *f, const wchar_t *name);
+extern int stfl_dump_cb(struct stfl_form *f, const wchar_t *name, const wchar_t *prefix, int focus,
+		int (*cb)(void *ctx, const wchar_t *text, size_t len), void *ctx);
+extern int stfl_dump_to_fd(struct stfl_form *f, const wchar_t *name, const wchar_t *prefix, int focus, int fd);
+extern int stfl_text_cb(struct stfl_form *f, const wchar_t *name,
+		int (*cb)(void *ctx, const wchar_t *text, size_t len), void *ctx);
+extern int stfl_text_to_fd(struct stfl_form *f, const wchar_t *name, int fd);
 
 extern void stfl_modify(struct stfl_form *f, const wchar_t *name, const wchar_t *mode, const wchar_t *text);
 
+extern void stfl_begin(struct stfl_form *f);
+extern void stfl_commit(struct stfl_form *f);
+
+extern long long stfl_checkpoint(struct stfl_form *f);
+extern const wchar_t *stfl_dump_delta(struct stfl_form *f, long long since);
+extern void stfl_apply_delta(struct stfl_form *f, const wchar_t *delta);
+
+extern const void *stfl_snapshot(struct stfl_form *f, size_t *size);
+extern struct stfl_form *stfl_restore(const void *data, size_t size);
+
+extern struct stfl_widget *stfl_widget_create(const wchar_t *type);
+extern void stfl_widget_destroy(struct stfl_widget *w);
+extern void stfl_widget_set_name(struct stfl_widget *w, const wchar_t *name);
+extern void stfl_widget_set_class(struct stfl_widget *w, const wchar_t *cls);
+extern void stfl_widget_set_kv(struct stfl_widget *w, const wchar_t *key, const wchar_t *name, const wchar_t *value);
+extern int stfl_widget_append_child(struct stfl_widget *parent, struct stfl_widget *child);
+extern void stfl_attach(struct stfl_form *f, const wchar_t *name, const wchar_t *mode, struct stfl_widget *w);
+
+extern struct stfl_template *stfl_template_create(const wchar_t *text);
+extern void stfl_template_free(struct stfl_template *t);
+extern void stfl_template_instantiate(struct stfl_form *f, const wchar_t *name, const wchar_t *mode,
+		struct stfl_template *t, ...);
+extern void stfl_template_instantiatev(struct stfl_form *f, const wchar_t *name, const wchar_t *mode,
+		struct stfl_template *t, const wchar_t **params);
+
+extern void stfl_stats_enable(struct stfl_form *f, int enable);
+extern const wchar_t *stfl_stats(struct stfl_form *f);
+extern void stfl_stats_reset(struct stfl_form *f);
+
+extern const wchar_t *stfl_memory_stats(struct stfl_form *f);
+
+extern void stfl_trace_enable(int enable);
+extern int stfl_trace_dump(int fd);
+
+extern int stfl_record_start(const char *filename);
+extern void stfl_record_stop();
+
 extern const wchar_t *stfl_error();
 extern void stfl_error_action(const wchar_t *mode);
 
@@ -62,6 +154,7 @@ extern const wchar_t *stfl_ipool_towc(struct stfl_ipool *pool, const char *buf);
 extern const char *stfl_ipool_fromwc(struct stfl_ipool *pool, const wchar_t *buf);
 extern void stfl_ipool_flush(struct stfl_ipool *pool);
 extern void stfl_ipool_destroy(struct stfl_ipool *pool);
+extern const wchar_t *stfl_ipool_stats(struct stfl_ipool *pool);
 
 #ifdef __cplusplus
 }
@@ -28,12 +28,16 @@ extern "C" {
 #endif
 
 #include "stfl.h"
+#include "stfl_probes.h"
 #include <ncursesw/ncurses.h>
 #include <pthread.h>
 
 struct stfl_widget_type;
 struct stfl_kv;
 struct stfl_widget;
+struct stfl_stats;
+struct stfl_screen;
+struct stfl_remote;
 
 struct stfl_widget_type {
 	wchar_t *name;
@@ -47,6 +51,8 @@ struct stfl_widget_type {
 	void (*f_prepare)(struct stfl_widget *w, struct stfl_form *f);
 	void (*f_draw)(struct stfl_widget *w, struct stfl_form *f, WINDOW *win);
 	int (*f_process)(struct stfl_widget *w, struct stfl_widget *fw, struct stfl_form *f, wchar_t ch, int is_function_key);
+
+	size_t (*f_memsize)(struct stfl_widget *w);
 };
 
 struct stfl_kv {
@@ -54,11 +60,13 @@ struct stfl_kv {
 	struct stfl_widget *widget;
 	wchar_t *key, *value, *name;
 	int id;
+	long long changed;
 };
 
 struct stfl_widget {
 	struct stfl_widget *parent;
 	struct stfl_widget *next_sibling;
+	struct stfl_widget *prev_sibling;
 	struct stfl_widget *first_child;
 	struct stfl_widget *last_child;
 	struct stfl_kv *kv_list;
@@ -68,6 +76,9 @@ struct stfl_widget {
 	int setfocus;
 	void *internal_data;
 	wchar_t *name, *cls;
+	wchar_t *lazy_src;
+	long long added, tree_changed, subtree_changed;
+	struct stfl_form *form;
 };
 
 struct stfl_event {
@@ -82,9 +93,46 @@ struct stfl_form {
 	struct stfl_event *event_queue;
 	wchar_t *event;
 	pthread_mutex_t mtx;
+	struct stfl_stats *stats;
+	int record_session, record_id;
+	int journal_focus_id;
+	long long focus_changed;
+	struct stfl_screen *screen;
+	int batch_depth;
+	int journal_active;
+};
+
+#define STFL_MAX_COLOR_PAIRS 256
+
+struct stfl_screen {
+	SCREEN *scr;
+	FILE *in, *out;
+	int in_fd;
+	int active;
+	int colorpair_counter;
+	int colorpair_bg[STFL_MAX_COLOR_PAIRS];
+	int colorpair_fg[STFL_MAX_COLOR_PAIRS];
+	struct stfl_remote *remote;
 };
 
-extern int stfl_colorpair_counter;
+extern struct stfl_screen stfl_screen_default;
+extern struct stfl_screen *stfl_screen_current;
+
+extern void stfl_screen_lock(struct stfl_screen *s);
+extern void stfl_screen_unlock();
+extern void stfl_screen_start(struct stfl_screen *s);
+extern void stfl_screen_stop(struct stfl_screen *s);
+extern int stfl_screen_get_wch(struct stfl_screen *s, int timeout, wint_t *wch);
+extern void stfl_screen_refresh(struct stfl_screen *s);
+extern void stfl_screen_flush(struct stfl_screen *s);
+
+extern int stfl_remote_open(struct stfl_screen *s, int in_fd, int out_fd);
+extern void stfl_remote_close(struct stfl_screen *s);
+extern void stfl_remote_frame(struct stfl_screen *s);
+extern void stfl_remote_flush(struct stfl_screen *s);
+extern void stfl_remote_redraw(struct stfl_screen *s);
+extern int stfl_remote_closed(struct stfl_screen *s);
+extern int stfl_remote_get_wch(struct stfl_screen *s, int timeout, wint_t *wch);
 
 extern struct stfl_widget_type *stfl_widget_types[];
 
@@ -101,15 +149,21 @@ extern struct stfl_widget_type stfl_widget_type_textedit;
 extern struct stfl_widget_type stfl_widget_type_checkbox;
 
 extern struct stfl_widget *stfl_widget_new(const wchar_t *type);
+extern struct stfl_widget *stfl_widget_new_type(struct stfl_widget_type *t, int setfocus);
 extern void stfl_widget_free(struct stfl_widget *w);
+extern void stfl_widget_link_child(struct stfl_widget *p, struct stfl_widget *c, struct stfl_widget *next);
+extern void stfl_widget_unlink(struct stfl_widget *w);
+extern struct stfl_widget *stfl_widget_copy(struct stfl_widget *w, const wchar_t **params);
 
 extern struct stfl_kv *stfl_widget_setkv_int(struct stfl_widget *w, const wchar_t *key, int value);
 extern struct stfl_kv *stfl_widget_setkv_str(struct stfl_widget *w, const wchar_t *key, const wchar_t *value);
+extern struct stfl_kv *stfl_widget_setkv_take(struct stfl_widget *w, wchar_t *key, wchar_t *value);
 
 extern struct stfl_kv *stfl_setkv_by_name_int(struct stfl_widget *w, const wchar_t *name, int value);
 extern struct stfl_kv *stfl_setkv_by_name_str(struct stfl_widget *w, const wchar_t *name, const wchar_t *value);
 
 extern struct stfl_kv *stfl_widget_getkv(struct stfl_widget *w, const wchar_t *key);
+extern struct stfl_kv *stfl_widget_getkv_worker(struct stfl_widget *w, const wchar_t *key);
 extern int stfl_widget_getkv_int(struct stfl_widget *w, const wchar_t *key, int defval);
 extern const wchar_t *stfl_widget_getkv_str(struct stfl_widget *w, const wchar_t *key, const wchar_t *defval);
 
@@ -130,6 +184,7 @@ extern int stfl_focus_prev(struct stfl_widget *w, struct stfl_widget *old_fw, st
 extern int stfl_focus_next(struct stfl_widget *w, struct stfl_widget *old_fw, struct stfl_form *f);
 
 extern struct stfl_form *stfl_form_new();
+extern void stfl_form_set_root(struct stfl_form *f, struct stfl_widget *root);
 extern void stfl_form_event(struct stfl_form *f, wchar_t *event);
 extern void stfl_form_run(struct stfl_form *f, int timeout);
 extern void stfl_form_reset();
@@ -139,11 +194,30 @@ extern void stfl_form_redraw();
 extern void stfl_check_setfocus(struct stfl_form *f, struct stfl_widget *w);
 
 extern struct stfl_widget *stfl_parser(const wchar_t *text);
+extern struct stfl_widget *stfl_parser_utf8(const char *text, size_t len);
 extern struct stfl_widget *stfl_parser_file(const char *filename);
+extern void stfl_widget_expand(struct stfl_widget *w);
+extern int stfl_lazy_has_name(const wchar_t *text, const wchar_t *name);
+
+extern void *stfl_binary_encode(struct stfl_widget *w, size_t *size);
+extern struct stfl_widget *stfl_binary_decode(const void *data, size_t size);
+extern int stfl_binary_check(const void *data, size_t size);
+extern char *stfl_static_encode(struct stfl_widget *w, const char *prefix, const char *source);
+extern struct stfl_widget *stfl_static_decode(const struct stfl_static_widget *widgets, const struct stfl_static_kv *kvs);
+extern void *stfl_snapshot_encode(struct stfl_form *f, size_t *size);
+extern struct stfl_form *stfl_snapshot_decode(const void *data, size_t size);
 
-extern wchar_t *stfl_quote_backend(const wchar_t *text);
 extern wchar_t *stfl_widget_dump(struct stfl_widget *w, const wchar_t *prefix, int focus_id);
-extern wchar_t *stfl_widget_text(struct stfl_widget *w);
+extern void stfl_widget_dump_reuse(struct stfl_widget *w, const wchar_t *prefix, int focus_id, wchar_t **text, size_t *size);
+extern void stfl_widget_text_reuse(struct stfl_widget *w, wchar_t **text, size_t *size);
+extern int stfl_widget_dump_sink(struct stfl_widget *w, const wchar_t *prefix, int focus_id,
+		int (*sink)(void *ctx, const wchar_t *text, size_t len), void *ctx);
+extern int stfl_widget_text_sink(struct stfl_widget *w,
+		int (*sink)(void *ctx, const wchar_t *text, size_t len), void *ctx);
+extern int stfl_utf8_put(char *buf, wchar_t wc);
+extern int stfl_fd_sink(void *ctx, const wchar_t *text, size_t len);
+extern void stfl_widget_delta_reuse(struct stfl_widget *w, long long since, int focus_id, long long focus_changed,
+		wchar_t **text, size_t *size);
 
 extern void stfl_style(WINDOW *win, const wchar_t *style);
 extern void stfl_widget_style(struct stfl_widget *w, struct stfl_form *f, WINDOW *win);
@@ -151,6 +225,108 @@ extern void stfl_widget_style(struct stfl_widget *w, struct stfl_form *f, WINDOW
 extern wchar_t *stfl_keyname(wchar_t ch, int isfunckey);
 extern int stfl_matchbind(struct stfl_widget *w, wchar_t ch, int isfunckey, wchar_t *name, wchar_t *auto_desc);
 
+enum stfl_stats_phase {
+	STFL_STATS_RUN,
+	STFL_STATS_REFRESH,
+	STFL_STATS_INPUT
+};
+
+extern __thread struct stfl_stats *stfl_stats_current;
+
+extern long long stfl_stats_now();
+extern struct stfl_stats *stfl_stats_new();
+extern void stfl_stats_clear(struct stfl_stats *s);
+extern void stfl_stats_free(struct stfl_stats *s);
+extern wchar_t *stfl_stats_dump(struct stfl_stats *s);
+extern wchar_t *stfl_memory_dump(struct stfl_form *f);
+extern wchar_t *stfl_ipool_dump(struct stfl_ipool *pool);
+
+extern void stfl_stats_prepare(struct stfl_widget *w, struct stfl_form *f);
+extern void stfl_stats_draw(struct stfl_widget *w, struct stfl_form *f, WINDOW *win);
+extern int stfl_stats_process(struct stfl_widget *w, struct stfl_widget *fw, struct stfl_form *f, wchar_t ch, int isfunckey);
+extern void stfl_stats_getkv(int result);
+extern void stfl_stats_form(struct stfl_stats *s, enum stfl_stats_phase phase, long long start);
+extern void stfl_stats_key(struct stfl_stats *s, long long time);
+extern void stfl_stats_painted(struct stfl_stats *s);
+extern void stfl_stats_hold(struct stfl_stats *s, long long start);
+
+extern int stfl_trace_enabled;
+
+extern void stfl_trace(enum stfl_trace_type type, struct stfl_form *f, long long arg1, long long arg2, const wchar_t *text);
+extern void stfl_trace_lock(struct stfl_form *f, const wchar_t *api);
+
+extern int stfl_record_active;
+
+extern void stfl_record_create(struct stfl_form *f, const wchar_t *text);
+extern void stfl_record_call(struct stfl_form *f, const char *op, int nstr, ...);
+extern void stfl_record_num(struct stfl_form *f, const char *op, long long arg);
+extern void stfl_record_key(struct stfl_form *f, int rc, wint_t wch);
+
+extern int stfl_journal_forms;
+
+extern long long stfl_journal_next();
+extern void stfl_journal_mark(struct stfl_widget *w, struct stfl_kv *kv, int added);
+
+/* change stamps for stfl_dump_delta(), only kept once a checkpoint was taken */
+
+static inline void stfl_journal_kv(struct stfl_kv *kv)
+{
+	if (stfl_journal_forms)
+		stfl_journal_mark(kv->widget, kv, 0);
+}
+
+static inline void stfl_journal_tree(struct stfl_widget *w)
+{
+	if (stfl_journal_forms)
+		stfl_journal_mark(w, 0, 0);
+}
+
+static inline void stfl_journal_added(struct stfl_widget *w)
+{
+	if (stfl_journal_forms)
+		stfl_journal_mark(w, 0, 1);
+}
+
+static inline void stfl_form_lock(struct stfl_form *f, const wchar_t *api)
+{
+	if (stfl_trace_enabled)
+		stfl_trace_lock(f, api);
+	else
+		pthread_mutex_lock(&f->mtx);
+}
+
+/* widget callbacks must be invoked through these so they can be timed */
+
+static inline void stfl_widget_prepare(struct stfl_widget *w, struct stfl_form *f)
+{
+	if (w->lazy_src)
+		stfl_widget_expand(w);
+
+	STFL_PROBE2(prepare_start, w, w->type->name);
+	if (f->stats)
+		stfl_stats_prepare(w, f);
+	else
+		w->type->f_prepare(w, f);
+	STFL_PROBE2(prepare_end, w, w->type->name);
+}
+
+static inline void stfl_widget_draw(struct stfl_widget *w, struct stfl_form *f, WINDOW *win)
+{
+	STFL_PROBE2(draw_start, w, w->type->name);
+	if (f->stats)
+		stfl_stats_draw(w, f, win);
+	else
+		w->type->f_draw(w, f, win);
+	STFL_PROBE2(draw_end, w, w->type->name);
+}
+
+static inline int stfl_widget_process(struct stfl_widget *w, struct stfl_widget *fw, struct stfl_form *f, wchar_t ch, int isfunckey)
+{
+	if (f->stats)
+		return stfl_stats_process(w, fw, f, ch, isfunckey);
+	return w->type->f_process(w, fw, f, ch, isfunckey);
+}
+
 extern unsigned int stfl_print_richtext(struct stfl_widget *w, WINDOW *win, unsigned int y, unsigned int x, const wchar_t * text, unsigned int width, const wchar_t * style, int has_focus);
 
 #ifdef __cplusplus
@@ -0,0 +1,41 @@
+/*
+ *  STFL - The Structured Terminal Forms Language/Library
+ *  Copyright (C) 2006, 2007  Clifford Wolf <clifford@clifford.at>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301 USA
+ *
+ *  stfl_probes.h: Static tracepoints (USDT) for perf, bpftrace and systemtap
+ */
+
+#ifndef STFL__PROBES_H
+#define STFL__PROBES_H 1
+
+/*
+ * Only compiled in when building with "make USDT=1". A probe is a single
+ * nop instruction as long as no tracer is attached to it.
+ */
+#ifdef STFL_USDT
+#  include <sys/sdt.h>
+#  define STFL_PROBE1(name, a)          DTRACE_PROBE1(stfl, name, a)
+#  define STFL_PROBE2(name, a, b)       DTRACE_PROBE2(stfl, name, a, b)
+#  define STFL_PROBE3(name, a, b, c)    DTRACE_PROBE3(stfl, name, a, b, c)
+#else
+#  define STFL_PROBE1(name, a)          do { } while (0)
+#  define STFL_PROBE2(name, a, b)       do { } while (0)
+#  define STFL_PROBE3(name, a, b, c)    do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ *  STFL - The Structured Terminal Forms Language/Library
+ *  Copyright (C) 2006, 2007  Clifford Wolf <clifford@clifford.at>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301 USA
+ *
+ *  stflc.c: Precompile STFL files to the binary form or to C source
+ */
+
+#include "stfl_internals.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+
+static int write_file(const char *filename, const void *data, size_t size)
+{
+	FILE *f = fopen(filename, "w");
+
+	if (!f || fwrite(data, 1, size, f) != size || fclose(f)) {
+		perror(filename);
+		return 0;
+	}
+
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *prefix = 0;
+
+	if (argc == 5 && !strcmp(argv[1], "-c")) {
+		prefix = argv[2];
+		argv += 2;
+		argc -= 2;
+	}
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s input.stfl output.stflc\n", argv[0]);
+		fprintf(stderr, "       %s -c prefix input.stfl output.c\n", argv[0]);
+		return 1;
+	}
+
+	if (!setlocale(LC_ALL, ""))
+		fprintf(stderr, "WARNING: Can't set locale!\n");
+
+	/* the input is read like an include file */
+	struct stfl_widget *root = stfl_parser_file(argv[1]);
+	int ok;
+
+	if (prefix) {
+		char *text = stfl_static_encode(root, prefix, argv[1]);
+		ok = write_file(argv[2], text, strlen(text));
+		free(text);
+	} else {
+		size_t size;
+		void *data = stfl_binary_encode(root, &size);
+		ok = write_file(argv[2], data, size);
+		free(data);
+	}
+
+	stfl_widget_free(root);
+	return ok ? 0 : 1;
+}
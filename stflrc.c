@@ -0,0 +1,270 @@
+/*
+ *  STFL - The Structured Terminal Forms Language/Library
+ *  Copyright (C) 2006, 2007  Clifford Wolf <clifford@clifford.at>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301 USA
+ *
+ *  stflrc.c: Client for remote screens which draws on the local terminal
+ */
+
+#include <ncursesw/ncurses.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <locale.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define MAX_ATTRS 256
+
+static int sock;
+
+static attr_t attr_curses[MAX_ATTRS];
+static short attr_pair[MAX_ATTRS];
+
+static short pair_fg[MAX_ATTRS], pair_bg[MAX_ATTRS];
+static int pairs_num = 1;
+
+static int cursor_y, cursor_x;
+
+static void send_msg(const char *fmt, int a, int b)
+{
+	char buf[64];
+	int len = snprintf(buf, sizeof(buf), fmt, a, b), n = 0;
+
+	while (n < len) {
+		ssize_t rc = write(sock, buf + n, len - n);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc <= 0)
+			return;
+		n += rc;
+	}
+}
+
+static short color_pair(int fg, int bg)
+{
+	int i;
+
+	if (fg < 0 && bg < 0)
+		return 0;
+
+	for (i=1; i<pairs_num; i++)
+		if (pair_fg[i] == fg && pair_bg[i] == bg)
+			return i;
+
+	if (i == MAX_ATTRS || i == COLOR_PAIRS)
+		return 0;
+
+	init_pair(i, fg < COLORS ? fg : -1, bg < COLORS ? bg : -1);
+	pair_fg[i] = fg;
+	pair_bg[i] = bg;
+	pairs_num++;
+	return i;
+}
+
+static void define_attr(int id, int bits, int fg, int bg)
+{
+	static const attr_t attrs[] = { A_BOLD, A_UNDERLINE, A_REVERSE, A_BLINK,
+			A_DIM, A_STANDOUT, A_PROTECT, A_INVIS, A_ALTCHARSET };
+	int i;
+
+	if (id < 0 || id >= MAX_ATTRS)
+		return;
+
+	attr_curses[id] = A_NORMAL;
+	for (i=0; i<(int)(sizeof(attrs)/sizeof(*attrs)); i++)
+		if (bits & (1 << i))
+			attr_curses[id] |= attrs[i];
+
+	attr_pair[id] = color_pair(fg, bg);
+}
+
+static void draw_text(int y, int x, int id, const unsigned char *text)
+{
+	wchar_t buf[strlen((const char *)text) + 1];
+	int n = 0;
+
+	while (*text) {
+		unsigned int ch = *text++;
+		int more = 0;
+
+		if ((ch & 0xe0) == 0xc0)
+			ch &= 0x1f, more = 1;
+		else if ((ch & 0xf0) == 0xe0)
+			ch &= 0x0f, more = 2;
+		else if ((ch & 0xf8) == 0xf0)
+			ch &= 0x07, more = 3;
+
+		while (more-- > 0 && (*text & 0xc0) == 0x80)
+			ch = (ch << 6) | (*text++ & 0x3f);
+
+		buf[n++] = ch;
+	}
+	buf[n] = 0;
+
+	if (id < 0 || id >= MAX_ATTRS)
+		id = 0;
+
+	wattr_set(stdscr, attr_curses[id], attr_pair[id], 0);
+	mvwaddwstr(stdscr, y, x, buf);
+}
+
+static void handle_msg(char *line)
+{
+	int a, b, c, d, n = 0;
+
+	switch (line[0])
+	{
+	case 'S':
+		wattr_set(stdscr, A_NORMAL, 0, 0);
+		werase(stdscr);
+		break;
+	case 'A':
+		if (sscanf(line+1, "%d %d %d %d", &a, &b, &c, &d) == 4)
+			define_attr(a, b, c, d);
+		break;
+	case 'T':
+		if (sscanf(line+1, "%d %d %d %n", &a, &b, &c, &n) == 3 && n > 0)
+			draw_text(a, b, c, (unsigned char *)line + 1 + n);
+		break;
+	case 'C':
+		if (sscanf(line+1, "%d %d", &a, &b) == 2)
+			cursor_y = a, cursor_x = b;
+		break;
+	case 'F':
+		wmove(stdscr, cursor_y, cursor_x);
+		wrefresh(stdscr);
+		break;
+	}
+}
+
+static void send_keys()
+{
+	wint_t wch;
+	int rc;
+
+	while ((rc = wget_wch(stdscr, &wch)) != ERR) {
+		if (rc == KEY_CODE_YES && wch == KEY_RESIZE)
+			send_msg("r %d %d\n", LINES, COLS);
+		else
+			send_msg(rc == KEY_CODE_YES ? "f %d\n" : "k %d\n", wch, 0);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int sv[2], status = 0;
+	char fdnum[16];
+	pid_t pid;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s program [args...]\n", argv[0]);
+		return 1;
+	}
+
+	if (!setlocale(LC_ALL, ""))
+		fprintf(stderr, "WARNING: Can't set locale!\n");
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		perror("socketpair");
+		return 1;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	}
+
+	if (pid == 0) {
+		close(sv[0]);
+		snprintf(fdnum, sizeof(fdnum), "%d", sv[1]);
+		setenv("STFL_REMOTE_FD", fdnum, 1);
+		execvp(argv[1], argv+1);
+		perror(argv[1]);
+		_exit(127);
+	}
+
+	close(sv[1]);
+	sock = sv[0];
+	signal(SIGPIPE, SIG_IGN);
+
+	initscr();
+	cbreak();
+	noecho();
+	nonl();
+	keypad(stdscr, TRUE);
+	nodelay(stdscr, TRUE);
+	start_color();
+	use_default_colors();
+
+	send_msg("r %d %d\n", LINES, COLS);
+
+	size_t len = 0, size = 4096;
+	char *buf = malloc(size);
+
+	while (1)
+	{
+		struct pollfd pfd[2] = { { 0, POLLIN, 0 }, { sock, POLLIN, 0 } };
+
+		if (poll(pfd, 2, -1) < 0) {
+			/* curses reports a SIGWINCH as KEY_RESIZE */
+			if (errno == EINTR) {
+				send_keys();
+				continue;
+			}
+			break;
+		}
+
+		if (pfd[0].revents)
+			send_keys();
+
+		if (!pfd[1].revents)
+			continue;
+
+		if (len == size)
+			buf = realloc(buf, size *= 2);
+
+		ssize_t rc = read(sock, buf + len, size - len);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc <= 0)
+			break;
+		len += rc;
+
+		char *p = buf, *nl;
+		while ((nl = memchr(p, '\n', buf + len - p)) != 0) {
+			*nl = 0;
+			handle_msg(p);
+			p = nl+1;
+		}
+		len -= p - buf;
+		memmove(buf, p, len);
+	}
+
+	endwin();
+	close(sock);
+	free(buf);
+
+	waitpid(pid, &status, 0);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
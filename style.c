@@ -44,13 +44,10 @@ static wchar_t *wcssep(wchar_t **stringp, const wchar_t *delim) {
 }
 
 
-#define STFL_MAX_COLOR_PAIRS 256
-static int stfl_colorpair_bg[STFL_MAX_COLOR_PAIRS];
-static int stfl_colorpair_fg[STFL_MAX_COLOR_PAIRS];
-int stfl_colorpair_counter = 1;
-
+/* color pairs are per terminal, the current screen is locked while drawing */
 void stfl_style(WINDOW *win, const wchar_t *style)
 {
+	struct stfl_screen *s = stfl_screen_current;
 	int bg_color = -1, fg_color = -1, attr = A_NORMAL;
 
 	style += wcsspn(style, L" \t");
@@ -165,12 +162,12 @@ void stfl_style(WINDOW *win, const wchar_t *style)
 		bg_color = b;
 
 	int i;
-	for (i=1; i<stfl_colorpair_counter; i++) {
-		if (stfl_colorpair_fg[i] == fg_color && stfl_colorpair_bg[i] == bg_color)
+	for (i=1; i<s->colorpair_counter; i++) {
+		if (s->colorpair_fg[i] == fg_color && s->colorpair_bg[i] == bg_color)
 			break;
 	}
 
-	if (i == stfl_colorpair_counter) {
+	if (i == s->colorpair_counter) {
 		if (i == COLOR_PAIRS) {
 			fprintf(stderr, "Ncurses limit of color pairs (%d) reached!\n", COLOR_PAIRS);
 			abort();
@@ -180,9 +177,9 @@ void stfl_style(WINDOW *win, const wchar_t *style)
 			abort();
 		}
 		init_pair(i, fg_color, bg_color);
-		stfl_colorpair_fg[i] = fg_color;
-		stfl_colorpair_bg[i] = bg_color;
-		stfl_colorpair_counter++;
+		s->colorpair_fg[i] = fg_color;
+		s->colorpair_bg[i] = bg_color;
+		s->colorpair_counter++;
 	}
 
 	wattrset(win, attr);
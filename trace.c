@@ -0,0 +1,133 @@
+/*
+ *  STFL - The Structured Terminal Forms Language/Library
+ *  Copyright (C) 2006, 2007  Clifford Wolf <clifford@clifford.at>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301 USA
+ *
+ *  trace.c: In-memory ring buffer of UI loop events
+ */
+
+#include "stfl_internals.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define TRACE_RING_SIZE 8192	/* must be a power of two */
+
+static struct stfl_trace_record trace_ring[TRACE_RING_SIZE];
+static unsigned int trace_head;
+
+int stfl_trace_enabled = 0;
+
+void stfl_trace_enable(int enable)
+{
+	stfl_trace_enabled = enable;
+}
+
+/*
+ * Lock-free: every writer claims its own slot. The sequence number is
+ * written last, so a reader can tell complete records from stale ones.
+ */
+void stfl_trace(enum stfl_trace_type type, struct stfl_form *f, long long arg1, long long arg2, const wchar_t *text)
+{
+	unsigned int seq = __sync_add_and_fetch(&trace_head, 1);
+	struct stfl_trace_record *r = &trace_ring[seq & (TRACE_RING_SIZE-1)];
+	int i;
+
+	r->seq = 0;
+	__sync_synchronize();
+
+	r->time_ns = stfl_stats_now();
+	r->form = (unsigned long)f;
+	r->arg1 = arg1;
+	r->arg2 = arg2;
+	r->type = type;
+
+	for (i=0; text && text[i] && i < (int)sizeof(r->text)-1; i++)
+		r->text[i] = text[i] < 128 ? text[i] : '?';
+	r->text[i] = 0;
+
+	__sync_synchronize();
+	r->seq = seq;
+}
+
+void stfl_trace_lock(struct stfl_form *f, const wchar_t *api)
+{
+	long long start = stfl_stats_now();
+	pthread_mutex_lock(&f->mtx);
+	stfl_trace(STFL_TRACE_LOCK, f, stfl_stats_now() - start, 0, api);
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len > 0) {
+		ssize_t rc = write(fd, p, len);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc <= 0)
+			return -1;
+		p += rc;
+		len -= rc;
+	}
+
+	return 0;
+}
+
+/* only uses write(), so this can be called from a signal handler */
+int stfl_trace_dump(int fd)
+{
+	unsigned int head = trace_head;
+	unsigned int first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE + 1 : 1;
+	unsigned int seq;
+
+	struct {
+		char magic[8];
+		unsigned int record_size;
+		unsigned int reserved;
+	} header;
+
+	memcpy(header.magic, "STFLTRC1", 8);
+	header.record_size = sizeof(struct stfl_trace_record);
+	header.reserved = 0;
+
+	if (write_all(fd, &header, sizeof(header)) < 0)
+		return -1;
+
+	/*
+	 * records which are written or overwritten while they are copied are
+	 * skipped, the writer clears the sequence number before it starts
+	 */
+	for (seq = first; seq != head + 1; seq++) {
+		struct stfl_trace_record *slot = &trace_ring[seq & (TRACE_RING_SIZE-1)];
+		struct stfl_trace_record r;
+
+		if (*(volatile unsigned int *)&slot->seq != seq)
+			continue;
+		__sync_synchronize();
+		memcpy(&r, slot, sizeof(r));
+		__sync_synchronize();
+		if (*(volatile unsigned int *)&slot->seq != seq)
+			continue;
+
+		if (write_all(fd, &r, sizeof(r)) < 0)
+			return -1;
+	}
+
+	return 0;
+}
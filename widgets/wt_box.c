@@ -48,6 +48,11 @@ static void wt_box_done(struct stfl_widget *w)
 	free(w->internal_data);
 }
 
+static size_t wt_box_memsize(struct stfl_widget *w)
+{
+	return sizeof(struct box_data);
+}
+
 static void wt_box_prepare(struct stfl_widget *w, struct stfl_form *f)
 {
 	struct box_data *d = w->internal_data;
@@ -58,7 +63,7 @@ static void wt_box_prepare(struct stfl_widget *w, struct stfl_form *f)
 	struct stfl_widget *c = w->first_child;
 	while (c) {
 		if (stfl_widget_getkv_int(c, L".display", 1)) {
-			c->type->f_prepare(c, f);
+			stfl_widget_prepare(c, f);
 			if (d->type == 'H') {
 				if (w->min_h < c->min_h)
 					w->min_h = c->min_h;
@@ -172,7 +177,7 @@ static void wt_box_draw(struct stfl_widget *w, struct stfl_form *f, WINDOW *win)
 			if (!wcschr(tie, L't') &&  wcschr(tie, L'b')) c->y += c->h - c->min_h;
 			if (!wcschr(tie, L't') || !wcschr(tie, L'b')) c->h = c->min_h;
 
-			c->type->f_draw(c, f, win);
+			stfl_widget_draw(c, f, win);
 		}
 		c = c->next_sibling;
 	}
@@ -209,7 +214,8 @@ struct stfl_widget_type stfl_widget_type_vbox = {
 	0, // f_leave
 	wt_box_prepare,
 	wt_box_draw,
-	wt_box_process
+	wt_box_process,
+	wt_box_memsize
 };
 
 struct stfl_widget_type stfl_widget_type_hbox = {
@@ -220,6 +226,7 @@ struct stfl_widget_type stfl_widget_type_hbox = {
 	0, // f_leave
 	wt_box_prepare,
 	wt_box_draw,
-	wt_box_process
+	wt_box_process,
+	wt_box_memsize
 };
 
@@ -77,6 +77,26 @@ static void wt_table_done(struct stfl_widget *w)
 		free_table_data(w->internal_data);
 }
 
+static size_t wt_table_memsize(struct stfl_widget *w)
+{
+	struct table_data *d = w->internal_data;
+	size_t size;
+	int i, j;
+
+	if (!d)
+		return 0;
+
+	size = sizeof(struct table_data);
+	size += (d->rows + d->cols) * sizeof(struct table_rowcol_data);
+
+	for (i=0; i < MAX_COLS; i++)
+	for (j=0; j < MAX_ROWS; j++)
+		if (d->map[i][j])
+			size += sizeof(struct table_cell_data);
+
+	return size;
+}
+
 static void wt_table_prepare(struct stfl_widget *w, struct stfl_form *f)
 {
 	struct table_data *d = calloc(1, sizeof(struct table_data));
@@ -165,7 +185,7 @@ static void wt_table_prepare(struct stfl_widget *w, struct stfl_form *f)
 
 			col_counter += colspan;
 		}
-		c->type->f_prepare(c, f);
+		stfl_widget_prepare(c, f);
 		c = c->next_sibling;
 	}
 
@@ -487,7 +507,7 @@ static void wt_table_draw(struct stfl_widget *w, struct stfl_form *f, WINDOW *wi
 				if (!wcschr(tie, L't') &&  wcschr(tie, L'b')) c->y += c->h - c->min_h;
 				if (!wcschr(tie, L't') || !wcschr(tie, L'b')) c->h = c->min_h;
 
-				c->type->f_draw(c, f, win);
+				stfl_widget_draw(c, f, win);
 			}
 			x += d->cold[i].size;
 		}
@@ -670,7 +690,8 @@ struct stfl_widget_type stfl_widget_type_table = {
 	0, // f_leave
 	wt_table_prepare,
 	wt_table_draw,
-	wt_table_process
+	wt_table_process,
+	wt_table_memsize
 };
 
 static void wt_tablebr_prepare(struct stfl_widget *w, struct stfl_form *f) { }
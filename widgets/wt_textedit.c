@@ -111,14 +111,12 @@ static int wt_textedit_process(struct stfl_widget *w, struct stfl_widget *fw, st
 	int cursor_y = stfl_widget_getkv_int(w, L"cursor_y", 0);
 	int num_lines = 0, line_length = 0;
 
-	struct stfl_widget *c_current_line = NULL;
-	struct stfl_widget *c = w->first_child;
-	while (c) {
-		if (num_lines == cursor_y) {
-			line_length = wcslen(stfl_widget_getkv_str(c, L"text", L""));
-			c_current_line = c;
-		}
-		c = c->next_sibling;
+	struct stfl_widget *c_current_line = w->first_child;
+	struct stfl_widget *c;
+
+	/* only walk up to the cursor, the lines below are counted on demand */
+	while (c_current_line && num_lines < cursor_y) {
+		c_current_line = c_current_line->next_sibling;
 		num_lines++;
 	}
 
@@ -129,17 +127,18 @@ static int wt_textedit_process(struct stfl_widget *w, struct stfl_widget *fw, st
 
 	if (c_current_line == NULL) {
 		c_current_line = stfl_widget_new(L"listitem");
-		w->last_child = c_current_line;
-		w->first_child = c_current_line;
-		num_lines = 1;
+		stfl_widget_link_child(w, c_current_line, 0);
+		stfl_journal_added(c_current_line);
 	}
 
+	line_length = wcslen(stfl_widget_getkv_str(c_current_line, L"text", L""));
+
 	if (cursor_y > 0 && stfl_matchbind(w, ch, isfunckey, L"up", L"UP")) {
 		stfl_widget_setkv_int(w, L"cursor_y", cursor_y-1);
 		return 1;
 	}
 		
-	if (cursor_y+1 < num_lines && stfl_matchbind(w, ch, isfunckey, L"down", L"DOWN")) {
+	if (c_current_line->next_sibling && stfl_matchbind(w, ch, isfunckey, L"down", L"DOWN")) {
 		stfl_widget_setkv_int(w, L"cursor_y", cursor_y+1);
 		return 1;
 	}
@@ -159,12 +158,14 @@ static int wt_textedit_process(struct stfl_widget *w, struct stfl_widget *fw, st
 	if (stfl_matchbind(w, ch, isfunckey, L"page_up", L"PPAGE")) {
 		cursor_y = cursor_y - w->h + 1;
 		cursor_y = cursor_y > 0 ? cursor_y : 0;
-		cursor_y = cursor_y < num_lines ? cursor_y : num_lines-1;
 		stfl_widget_setkv_int(w, L"cursor_y", cursor_y);
 		return 1;
 	}
 
 	if (stfl_matchbind(w, ch, isfunckey, L"page_down", L"NPAGE")) {
+		num_lines = cursor_y + 1;
+		for (c = c_current_line->next_sibling; c; c = c->next_sibling)
+			num_lines++;
 		cursor_y = cursor_y + w->h - 1;
 		cursor_y = cursor_y > 0 ? cursor_y : 0;
 		cursor_y = cursor_y < num_lines ? cursor_y : num_lines-1;
@@ -218,9 +219,7 @@ static int wt_textedit_process(struct stfl_widget *w, struct stfl_widget *fw, st
 			cursor_x = line_length;
 
 		if (cursor_x == 0) {
-			struct stfl_widget *c = w->first_child;
-			while (c && c->next_sibling != c_current_line)
-				c = c->next_sibling;
+			c = c_current_line->prev_sibling;
 			if (c == NULL)
 				return 0;
 			const wchar_t *prev_text = stfl_widget_getkv_str(c, L"text", L"");
@@ -248,12 +247,8 @@ static int wt_textedit_process(struct stfl_widget *w, struct stfl_widget *fw, st
 	{
 		if (c_current_line == NULL) {
 			c_current_line = stfl_widget_new(L"listitem");
-			c_current_line->parent = w;
-			if (w->last_child)
-				w->last_child->next_sibling = c_current_line;
-			else
-				w->first_child = c_current_line;
-			w->last_child = c_current_line;
+			stfl_widget_link_child(w, c_current_line, 0);
+			stfl_journal_added(c_current_line);
 			return 1;
 		}
 
@@ -261,12 +256,8 @@ static int wt_textedit_process(struct stfl_widget *w, struct stfl_widget *fw, st
 			cursor_x = line_length;
 
 		c = stfl_widget_new(L"listitem");
-		c->parent = w;
-		c->next_sibling = c_current_line->next_sibling;
-		c_current_line->next_sibling = c;
-
-		if (w->last_child == c_current_line)
-			w->last_child = c;
+		stfl_widget_link_child(w, c, c_current_line->next_sibling);
+		stfl_journal_added(c);
 
 		const wchar_t *text = stfl_widget_getkv_str(c_current_line, L"text", L"");
 		stfl_widget_setkv_str(c, L"text", text + cursor_x);
@@ -285,12 +276,8 @@ static int wt_textedit_process(struct stfl_widget *w, struct stfl_widget *fw, st
 	{
 		if (c_current_line == NULL) {
 			c_current_line = stfl_widget_new(L"listitem");
-			c_current_line->parent = w;
-			if (w->last_child)
-				w->last_child->next_sibling = c_current_line;
-			else
-				w->first_child = c_current_line;
-			w->last_child = c_current_line;
+			stfl_widget_link_child(w, c_current_line, 0);
+			stfl_journal_added(c_current_line);
 		}
 
 		if (cursor_x > line_length)